@@ -1,8 +1,12 @@
 #include <dpu_mine.h>
 
-static ans_t __imp_clique2(sysname_t tasklet_id, node_t root) {
-    edge_ptr root_begin = row_ptr[root];  // intended DMA
-    edge_ptr root_end = row_ptr[root + 1];  // intended DMA
+static ans_t __imp_clique2(sysname_t tasklet_id, node_t root, edge_ptr root_begin, edge_ptr root_end) {
+#ifdef ORIENTED
+    // every stored neighbor is lower than root
+    (void)tasklet_id;
+    (void)root;
+    return root_end - root_begin;
+#else
     ans_t ans = 0;
     node_t *tasklet_buf = buf[tasklet_id][0];
 
@@ -21,6 +25,7 @@ static ans_t __imp_clique2(sysname_t tasklet_id, node_t root) {
         j = 0;
     }
     return ans;
+#endif
 }
 
 extern void clique2(sysname_t tasklet_id) {
@@ -28,12 +33,21 @@ extern void clique2(sysname_t tasklet_id) {
     
     for (node_t i = tasklet_id; i < root_num; i += NR_TASKLETS) {
         node_t root = roots[i];  // intended DMA
+        edge_ptr root_begin = row_ptr[root];  // intended DMA
+        edge_ptr root_end = row_ptr[root + 1];  // intended DMA
+#ifdef SPLIT_ROOTS
+        // only the ALL_PATTERNS binary hands split roots to clique2
+        if (i < split_num) {
+            root_end = root_begin + split_range[i][1];  // intended DMA
+            root_begin += split_range[i][0];  // intended DMA
+        }
+#endif
 #ifdef PERF
         timer_start(&cycles[tasklet_id]);
 #endif
-        ans[i] = __imp_clique2(tasklet_id, root);  // intended DMA
+        STORE_ANS(tasklet_id, i, __imp_clique2(tasklet_id, root, root_begin, root_end));
 #ifdef PERF
-        cycle_ct[i] = timer_stop(&cycles[tasklet_id]);  // intended DMA
+        STORE_CYCLE(tasklet_id, i, timer_stop(&cycles[tasklet_id]));
 #endif
     }
 }
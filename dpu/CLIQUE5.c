@@ -65,7 +65,9 @@ static ans_t __imp_clique5(sysname_t tasklet_id, node_t root) {
     ans_t ans = 0;
     for (edge_ptr i = root_begin; i < root_end; i++) {
         node_t second_root = col_idx[i];  // intended DMA
+#ifndef ORIENTED
         if (second_root >= root) break;
+#endif
         ans += __imp_clique5_2(tasklet_id, root, second_root);
     }
     return ans;
@@ -84,6 +86,13 @@ extern void clique5(sysname_t tasklet_id) {
         if (root_end - root_begin < BRANCH_LEVEL_THRESHOLD) {
             break;
         }
+        node_t split_begin = root_begin, split_end = root_end;
+#ifdef SPLIT_ROOTS
+        if (i < split_num) {
+            split_begin = root_begin + split_range[i][0];  // intended DMA
+            split_end = root_begin + split_range[i][1];  // intended DMA
+        }
+#endif
 #ifdef PERF
         timer_start(&cycles[tasklet_id]);
 #endif
@@ -93,9 +102,13 @@ extern void clique5(sysname_t tasklet_id) {
 
         barrier_wait(&co_barrier);
         partial_ans[tasklet_id] = 0;
-        for (edge_ptr j = root_begin + tasklet_id; j < root_end; j += NR_TASKLETS) {
+        for (edge_ptr j = split_begin + tasklet_id; j < split_end; j += NR_TASKLETS) {
+#if !defined(ORIENTED) || !defined(BITMAP)
             node_t second_root = col_idx[j];  // intended DMA
+#endif
+#ifndef ORIENTED
             if (second_root >= root) break;
+#endif
 #ifdef BITMAP
             partial_ans[tasklet_id] += __imp_clique5_bitmap(tasklet_id, j - root_begin);
 #else
@@ -117,9 +130,9 @@ extern void clique5(sysname_t tasklet_id) {
                 total_cycle += partial_cycle[j];
 #endif
             }
-            ans[i] = total_ans;  // intended DMA
+            STORE_ANS(tasklet_id, i, total_ans);
 #ifdef PERF
-            cycle_ct[i] = total_cycle;  // intended DMA
+            STORE_CYCLE(tasklet_id, i, total_cycle);
 #endif
         }
         i++;
@@ -130,9 +143,9 @@ extern void clique5(sysname_t tasklet_id) {
 #ifdef PERF
         timer_start(&cycles[tasklet_id]);
 #endif
-        ans[i] = __imp_clique5(tasklet_id, root);  // intended DMA
+        STORE_ANS(tasklet_id, i, __imp_clique5(tasklet_id, root));
 #ifdef PERF
-        cycle_ct[i] = timer_stop(&cycles[tasklet_id]);  // intended DMA
+        STORE_CYCLE(tasklet_id, i, timer_stop(&cycles[tasklet_id]));
 #endif
     }
 }
\ No newline at end of file
@@ -44,13 +44,20 @@ extern void cycle4(sysname_t tasklet_id) {
         if (root_end - root_begin < BRANCH_LEVEL_THRESHOLD) {
             break;
         }
+        node_t split_begin = root_begin, split_end = root_end;
+#ifdef SPLIT_ROOTS
+        if (i < split_num) {
+            split_begin = root_begin + split_range[i][0];  // intended DMA
+            split_end = root_begin + split_range[i][1];  // intended DMA
+        }
+#endif
 
         barrier_wait(&co_barrier);
 #ifdef PERF
         timer_start(&cycles[tasklet_id]);
 #endif
         partial_ans[tasklet_id] = 0;
-        for (edge_ptr j = root_begin + tasklet_id; j < root_end; j += NR_TASKLETS) {
+        for (edge_ptr j = split_begin + tasklet_id; j < split_end; j += NR_TASKLETS) {
             node_t second_root = col_idx[j];  // intended DMA
             if (second_root >= root) break;
             partial_ans[tasklet_id] += __imp_cycle4_2(tasklet_id, root, second_root);
@@ -70,9 +77,9 @@ extern void cycle4(sysname_t tasklet_id) {
                 total_cycle += partial_cycle[j];
 #endif
             }
-            ans[i] = total_ans;  // intended DMA
+            STORE_ANS(tasklet_id, i, total_ans);
 #ifdef PERF
-            cycle_ct[i] = total_cycle;  // intended DMA
+            STORE_CYCLE(tasklet_id, i, total_cycle);
 #endif
         }
         i++;
@@ -83,9 +90,9 @@ extern void cycle4(sysname_t tasklet_id) {
 #ifdef PERF
         timer_start(&cycles[tasklet_id]);
 #endif
-        ans[i] = __imp_cycle4(tasklet_id, root);  // intended DMA
+        STORE_ANS(tasklet_id, i, __imp_cycle4(tasklet_id, root));
 #ifdef PERF
-        cycle_ct[i] = timer_stop(&cycles[tasklet_id]);  // intended DMA
+        STORE_CYCLE(tasklet_id, i, timer_stop(&cycles[tasklet_id]));
 #endif
     }
 }
\ No newline at end of file
@@ -6,8 +6,25 @@
 #include <alloc.h>
 #include <barrier.h>
 #include <perfcounter.h>
+#ifdef TOTAL_ONLY
+#include <dpu_mine.h>
+#endif
+
+#ifdef ALL_PATTERNS
+extern void clique2(sysname_t tasklet_id);
+extern void clique3(sysname_t tasklet_id);
+extern void clique4(sysname_t tasklet_id);
+extern void clique5(sysname_t tasklet_id);
+extern void cycle4(sysname_t tasklet_id);
+extern void house5(sysname_t tasklet_id);
+extern void tri_tri6(sysname_t tasklet_id);
 
+// indexed by the PATTERN_* ids
+static void (*const kernels[NR_PATTERNS])(sysname_t tasklet_id) = {clique2, clique3, clique4, clique5, cycle4, house5, tri_tri6};
+__host uint64_t pattern_id;
+#else
 extern void KERNEL_FUNC(sysname_t tasklet_id);
+#endif
 
 BARRIER_INIT(my_barrier, NR_TASKLETS);
 
@@ -22,8 +39,29 @@ int main() {
 		perfcounter_config(COUNT_CYCLES, true);
 #endif
 	}
+#ifdef TOTAL_ONLY
+	tasklet_ans[tasklet_id] = 0;
+	tasklet_cycle[tasklet_id] = 0;
+#endif
 	barrier_wait(&my_barrier);
 
+#ifdef ALL_PATTERNS
+	kernels[pattern_id](tasklet_id);
+#else
 	KERNEL_FUNC(tasklet_id);
+#endif
+
+#ifdef TOTAL_ONLY
+	// the host reads one count per dpu instead of one per root
+	barrier_wait(&my_barrier);
+	if (tasklet_id == 0) {
+		ans_sum = 0;
+		cycle_sum = 0;
+		for (uint32_t i = 0; i < NR_TASKLETS; i++) {
+			ans_sum += tasklet_ans[i];
+			cycle_sum += tasklet_cycle[i];
+		}
+	}
+#endif
 	return 0;
 }
\ No newline at end of file
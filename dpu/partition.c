@@ -1,14 +1,15 @@
 #include <common.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <mram.h>
 #include <defs.h>
 #include <alloc.h>
-#include <mutex.h>
+#include <mutex_pool.h>
 #include <barrier.h>
 
-__mram_noinit_keep uint32_t bitmap[N >> 5];
-__mram_noinit_keep uint32_t involve_bitmap[N >> 5];
-__mram_noinit_keep uint32_t renumber[N];
+__mram_noinit_keep uint32_t bitmap[PARTITION_N >> 5];
+__mram_noinit_keep uint32_t involve_bitmap[PARTITION_N >> 5];
+__mram_noinit_keep uint32_t renumber[PARTITION_N];
 __mram_noinit_keep edge_ptr row_ptr[PARTITION_M];
 __mram_noinit_keep node_t col_idx[PARTITION_M];
 __mram_noinit_keep edge_ptr processed_row_ptr[PARTITION_M];
@@ -20,87 +21,252 @@ __host uint64_t root_size;
 __host uint64_t mode;   // 0 for first round, 1 for renumber, 2 for second round
 __host uint64_t processed_row_size;
 __host uint64_t processed_col_size;
-__host uint64_t processed_offset;
+__host uint64_t processed_offset;   // advanced by every mode 2 launch
 
-MUTEX_INIT(latch);
+MUTEX_POOL_INIT(latch, GRANULE_LATCH_NUM);   // striped over the 64-bit granules of mram
 BARRIER_INIT(barrier, NR_TASKLETS);
 
+__dma_aligned uint32_t wram_buf[NR_TASKLETS][4][PARTITION_BLOCK];
+uint32_t row_count[NR_TASKLETS];
+uint32_t col_count[NR_TASKLETS];
+
+// sequential reads of a 4-byte mram array through a wram block
+typedef struct InStream {
+    __mram_ptr uint32_t *base;
+    uint32_t *buf;
+    uint32_t buf_begin;
+} InStream;
+
+static inline void in_stream_init(InStream *s, __mram_ptr uint32_t *base, uint32_t *buf) {
+    s->base = base;
+    s->buf = buf;
+    s->buf_begin = INVALID_NODE;
+}
+
+static inline uint32_t in_stream_get(InStream *s, uint32_t pos) {
+    if (pos < s->buf_begin || pos >= s->buf_begin + PARTITION_BLOCK) {
+        s->buf_begin = ALIGN2_LOWER(pos);
+        mram_read(s->base + s->buf_begin, s->buf, PARTITION_BLOCK * sizeof(uint32_t));
+    }
+    return s->buf[pos - s->buf_begin];
+}
+
+// sequential writes of a 4-byte mram array through a wram block, a granule shared with
+// the neighboring tasklet is patched under the latch
+typedef struct OutStream {
+    __mram_ptr uint32_t *base;
+    uint32_t *buf;
+    uint32_t pos;
+    uint32_t fill;
+} OutStream;
+
+static inline void write_shared(__mram_ptr uint32_t *base, uint32_t pos, uint32_t val) {
+    __dma_aligned uint32_t granule[2];
+    mutex_pool_lock(&latch, pos >> 1);
+    mram_read(base + ALIGN2_LOWER(pos), granule, sizeof(granule));
+    granule[pos & 1] = val;
+    mram_write(granule, base + ALIGN2_LOWER(pos), sizeof(granule));
+    mutex_pool_unlock(&latch, pos >> 1);
+}
+
+static inline void out_stream_init(OutStream *s, __mram_ptr uint32_t *base, uint32_t *buf, uint32_t pos) {
+    s->base = base;
+    s->buf = buf;
+    s->pos = pos;
+    s->fill = 0;
+}
+
+static inline void out_stream_put(OutStream *s, uint32_t val) {
+    if (s->fill == 0 && (s->pos & 1)) {
+        write_shared(s->base, s->pos++, val);
+        return;
+    }
+    s->buf[s->fill++] = val;
+    if (s->fill == PARTITION_BLOCK) {
+        mram_write(s->buf, s->base + s->pos, PARTITION_BLOCK * sizeof(uint32_t));
+        s->pos += PARTITION_BLOCK;
+        s->fill = 0;
+    }
+}
+
+static inline void out_stream_flush(OutStream *s) {
+    uint32_t aligned = ALIGN2_LOWER(s->fill);
+    if (aligned) {
+        mram_write(s->buf, s->base + s->pos, aligned * sizeof(uint32_t));
+    }
+    if (s->fill & 1) {
+        write_shared(s->base, s->pos + aligned, s->buf[aligned]);
+    }
+    s->pos += s->fill;
+    s->fill = 0;
+}
+
+// or the pending bits of one granule into involve_bitmap
+static inline void flush_involve(uint32_t granule, uint64_t bits) {
+    __mram_ptr uint64_t *involve = (__mram_ptr uint64_t *)involve_bitmap;
+    mutex_pool_lock(&latch, granule);
+    involve[granule] |= bits;   // intended DMA
+    mutex_pool_unlock(&latch, granule);
+}
+
+// neighbors are sorted, so consecutive marks mostly hit the same granule and are merged in wram
+static inline void mark_involve(node_t node, uint32_t *granule, uint64_t *pending) {
+    if ((node >> 6) != *granule) {
+        if (*pending) flush_involve(*granule, *pending);
+        *granule = node >> 6;
+        *pending = 0;
+    }
+    *pending |= (uint64_t)1 << (node & 63);
+}
+
+// first row of the chunk with at least target rows plus edges before it, so that every tasklet
+// gets a contiguous range with a similar amount of work
+static node_t chunk_split(__mram_ptr edge_ptr *row_ptr_buf, edge_ptr offset, uint64_t target) {
+    node_t l = 0, r = size;
+    while (l < r) {
+        node_t mid = (l + r) >> 1;
+        if ((uint64_t)(row_ptr_buf[mid] - offset) + mid < target) {   // intended DMA
+            l = mid + 1;
+        }
+        else {
+            r = mid;
+        }
+    }
+    return l;
+}
+
+static inline bool test_bit(__mram_ptr uint32_t *bits, uint32_t *cur_word, uint32_t *cur_bits, node_t node) {
+    if ((node >> 5) != *cur_word) {
+        *cur_word = node >> 5;
+        *cur_bits = bits[node >> 5];   // intended DMA
+    }
+    return *cur_bits & (1 << (node & 31));
+}
+
 int main() {
     sysname_t tasklet_id = me();
     if (tasklet_id == 0) {
         mem_reset();
     }
 
-    if (mode == 0) {
-        uint32_t cur_bitmap = 0;
-        edge_ptr offset = row_ptr[0];
-        for (node_t i = tasklet_id; i < size; i += NR_TASKLETS) {
-            cur_bitmap = bitmap[(start + i) >> 5];   // intended DMA
-            if (cur_bitmap & (1 << ((start + i) & 31))) {
-                mutex_lock(latch);
-                involve_bitmap[(start + i) >> 5] |= (1 << ((start + i) & 31));   // intended DMA
-                mutex_unlock(latch);
-                edge_ptr node_begin = row_ptr[i] - offset;   // intended DMA
-                edge_ptr node_end = row_ptr[i + 1] - offset;   // intended DMA
-                for (edge_ptr j = node_begin; j < node_end; j++) {
-                    node_t neighbor = col_idx[j];   // intended DMA  TODO: optimize
-                    mutex_lock(latch);
-                    involve_bitmap[neighbor >> 5] |= (1 << (neighbor & 31));   // intended DMA
-                    mutex_unlock(latch);
+    if (mode == 0 || mode == 2) {
+        __mram_ptr edge_ptr *row_ptr_buf = row_ptr;
+        __mram_ptr node_t *col_idx_buf = col_idx;
+        edge_ptr offset = row_ptr_buf[0];   // intended DMA
+        uint64_t total = (uint64_t)(row_ptr_buf[size] - offset) + size;   // intended DMA
+        node_t row_begin = chunk_split(row_ptr_buf, offset, total * tasklet_id / NR_TASKLETS);
+        node_t row_end = chunk_split(row_ptr_buf, offset, total * (tasklet_id + 1) / NR_TASKLETS);
+        InStream row_in, col_in;
+        in_stream_init(&row_in, row_ptr_buf, wram_buf[tasklet_id][0]);
+        in_stream_init(&col_in, col_idx_buf, wram_buf[tasklet_id][1]);
+        uint32_t bitmap_word = INVALID_NODE, bitmap_bits = 0;
+        uint32_t involve_word = INVALID_NODE, involve_bits = 0;
+
+        if (mode == 0) {
+            uint32_t granule = INVALID_NODE;
+            uint64_t pending = 0;
+            for (node_t i = row_begin; i < row_end; i++) {
+                if (test_bit(bitmap, &bitmap_word, &bitmap_bits, start + i)) {
+                    mark_involve(start + i, &granule, &pending);
+                    edge_ptr node_begin = in_stream_get(&row_in, i) - offset;
+                    edge_ptr node_end = in_stream_get(&row_in, i + 1) - offset;
+                    for (edge_ptr j = node_begin; j < node_end; j++) {
+                        mark_involve(in_stream_get(&col_in, j), &granule, &pending);
+                    }
                 }
             }
+            if (pending) flush_involve(granule, pending);
+            return 0;
         }
-    }
-    else if (mode == 1) {
-        if (tasklet_id != 0) return 0;
-        node_t cur = 0;
-        node_t n = (size + 31) >> 5;
-        for (node_t i = 0; i < n; i++) {
-            uint32_t cur_bitmap = involve_bitmap[i];   // intended DMA
-            for (node_t j = 0; j < 32; j++) {
-                if (cur_bitmap & (1 << j)) {
-                    renumber[(i << 5) | j] = cur;
-                    cur++;
+
+        // count the rows and edges of this tasklet, then write them at the prefix sums
+        uint32_t rows = 0, cols = 0;
+        for (node_t i = row_begin; i < row_end; i++) {
+            if (test_bit(involve_bitmap, &involve_word, &involve_bits, start + i)) {
+                rows++;
+                if (test_bit(bitmap, &bitmap_word, &bitmap_bits, start + i)) {
+                    cols += in_stream_get(&row_in, i + 1) - in_stream_get(&row_in, i);
                 }
             }
         }
-        for (node_t i = 0; i < root_size; i++) {
-            roots[i] = renumber[roots[i]];   // intended DMA
+        row_count[tasklet_id] = rows;
+        col_count[tasklet_id] = cols;
+        barrier_wait(&barrier);
+        uint32_t row_pos = 0, col_pos = 0;
+        for (uint32_t t = 0; t < tasklet_id; t++) {
+            row_pos += row_count[t];
+            col_pos += col_count[t];
         }
-    }
-    else if (mode == 2) {
-        if (tasklet_id != 0) return 0;
-        uint32_t cur_bitmap = 0;
-        uint32_t cur_involve_bitmap = 0;
-        edge_ptr offset = row_ptr[0];
-        uint64_t row_size = 0;
-        uint64_t col_size = 0;
-        uint32_t need_fetch = 1;
-        for (node_t i = 0; i < size; i++) {
-            if (need_fetch) {
-                cur_bitmap = bitmap[(start + i) >> 5];   // intended DMA
-                cur_involve_bitmap = involve_bitmap[(start + i) >> 5];   // intended DMA
-                need_fetch = 0;
-            }
-            if (cur_involve_bitmap & (1 << ((start + i) & 31))) {
-                processed_row_ptr[row_size] = col_size + processed_offset;   // intended DMA
-                row_size++;
-                if (cur_bitmap & (1 << ((start + i) & 31))) {
-                    edge_ptr node_begin = row_ptr[i] - offset;   // intended DMA
-                    edge_ptr node_end = row_ptr[i + 1] - offset;   // intended DMA
+        OutStream row_out, col_out;
+        out_stream_init(&row_out, processed_row_ptr, wram_buf[tasklet_id][2], row_pos);
+        out_stream_init(&col_out, processed_col_idx, wram_buf[tasklet_id][3], col_pos);
+        for (node_t i = row_begin; i < row_end; i++) {
+            if (test_bit(involve_bitmap, &involve_word, &involve_bits, start + i)) {
+                out_stream_put(&row_out, col_out.pos + col_out.fill + processed_offset);
+                if (test_bit(bitmap, &bitmap_word, &bitmap_bits, start + i)) {
+                    edge_ptr node_begin = in_stream_get(&row_in, i) - offset;
+                    edge_ptr node_end = in_stream_get(&row_in, i + 1) - offset;
                     for (edge_ptr j = node_begin; j < node_end; j++) {
-                        node_t new_idx = renumber[col_idx[j]];   // intended DMA
-                        processed_col_idx[col_size] = new_idx;   // intended DMA
-                        col_size++;
+                        out_stream_put(&col_out, renumber[in_stream_get(&col_in, j)]);   // intended DMA
+                    }
+                }
+            }
+        }
+        out_stream_flush(&row_out);
+        out_stream_flush(&col_out);
+        barrier_wait(&barrier);
+        if (tasklet_id == NR_TASKLETS - 1) {
+            processed_row_size = row_out.pos;
+            processed_col_size = col_out.pos;
+            processed_offset += col_out.pos;
+        }
+    }
+    else if (mode == 1) {
+        // every tasklet numbers a contiguous range of involve_bitmap words after the popcount
+        // of the ranges before it
+        node_t words = (size + 31) >> 5;
+        node_t word_begin = ALIGN2_LOWER(words * tasklet_id / NR_TASKLETS);
+        node_t word_end = tasklet_id == NR_TASKLETS - 1 ? words : ALIGN2_LOWER(words * (tasklet_id + 1) / NR_TASKLETS);
+        InStream word_in;
+        in_stream_init(&word_in, involve_bitmap, wram_buf[tasklet_id][0]);
+        uint32_t count = 0;
+        for (node_t w = word_begin; w < word_end; w++) {
+            count += __builtin_popcount(in_stream_get(&word_in, w));
+        }
+        row_count[tasklet_id] = count;
+        barrier_wait(&barrier);
+        node_t cur = 0;
+        for (uint32_t t = 0; t < tasklet_id; t++) {
+            cur += row_count[t];
+        }
+        // renumber of nodes outside involve_bitmap is never read, so whole words are written
+        uint32_t *renumber_buf = wram_buf[tasklet_id][1];
+        for (node_t w = word_begin; w < word_end; w += PARTITION_BLOCK >> 5) {
+            node_t block_words = MIN(PARTITION_BLOCK >> 5, word_end - w);
+            for (node_t k = 0; k < block_words; k++) {
+                uint32_t cur_bitmap = in_stream_get(&word_in, w + k);
+                for (node_t j = 0; j < 32; j++) {
+                    if (cur_bitmap & (1 << j)) {
+                        renumber_buf[(k << 5) | j] = cur;
+                        cur++;
                     }
                 }
             }
-            if (((start + i) & 31) == 31) {
-                need_fetch = 1;
+            mram_write(renumber_buf, &renumber[w << 5], block_words << 5 << SIZE_NODE_T_LOG);
+        }
+        barrier_wait(&barrier);
+
+        node_t root_begin = ALIGN2_LOWER(root_size * tasklet_id / NR_TASKLETS);
+        node_t root_end = tasklet_id == NR_TASKLETS - 1 ? root_size : ALIGN2_LOWER(root_size * (tasklet_id + 1) / NR_TASKLETS);
+        uint32_t *root_buf = wram_buf[tasklet_id][2];
+        for (node_t i = root_begin; i < root_end; i += PARTITION_BLOCK) {
+            node_t block_size = MIN(PARTITION_BLOCK, root_end - i);
+            mram_read(&roots[i], root_buf, ALIGN8(block_size << SIZE_NODE_T_LOG));
+            for (node_t k = 0; k < block_size; k++) {
+                root_buf[k] = renumber[root_buf[k]];   // intended DMA
             }
+            mram_write(root_buf, &roots[i], ALIGN8(block_size << SIZE_NODE_T_LOG));
         }
-        processed_row_size = row_size;
-        processed_col_size = col_size;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,289 @@
+#include <common.h>
+#include <partition.h>
+#include <parallel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cache file layout:
+//   CacheHeader
+//   row_ptr[n + 1], col_idx[m]                     renumbered graph
+//   root_num[part_num], spare_num[part_num], split_num[part_num]
+//   own and spare roots of every part              global ids
+//   split ranges of every part
+//   cpu_root_num, roots of the host threads        global ids
+//   if compacted:
+//     row_size[part_num], col_size[part_num]
+//     row_ptr, col_idx, own and spare roots        local ids
+#define CACHE_MAGIC "PIMPAM05"
+#define CACHE_CHUNK (1 << 24)
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct CacheHeader {
+    char magic[8];
+    uint64_t key;
+    uint64_t n;
+    uint64_t m;
+    uint64_t nr_dpus;
+    uint64_t epoch_num;
+    uint64_t compacted;
+} CacheHeader;
+
+typedef struct HashArgs {
+    const uint8_t *data;
+    size_t size;
+    uint64_t chunk_num;
+    uint64_t *chunk_hash;
+} HashArgs;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *p = data;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(uint64_t));
+        hash ^= word;
+        hash *= FNV_PRIME;
+    }
+    for (; i < size; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static void hash_chunks(uint32_t tid, uint32_t nr_threads, void *arg) {
+    HashArgs *args = arg;
+    for (uint64_t i = tid; i < args->chunk_num; i += nr_threads) {
+        size_t begin = i * CACHE_CHUNK;
+        size_t size = MIN((size_t)CACHE_CHUNK, args->size - begin);
+        args->chunk_hash[i] = fnv1a(FNV_OFFSET, args->data + begin, size);
+    }
+}
+
+static uint64_t hash_parallel(const void *data, size_t size) {
+    HashArgs args;
+    args.data = data;
+    args.size = size;
+    args.chunk_num = (size + CACHE_CHUNK - 1) / CACHE_CHUNK;
+    args.chunk_hash = malloc((args.chunk_num + 1) * sizeof(uint64_t));
+    parallel_run(hash_chunks, &args);
+    uint64_t hash = fnv1a(FNV_OFFSET, args.chunk_hash, args.chunk_num * sizeof(uint64_t));
+    free(args.chunk_hash);
+    return hash;
+}
+
+// hash of the input file, of the workload profile if any, and of every parameter that
+// changes the preprocessing result
+uint64_t cache_key(const void *data, size_t size, const void *profile, size_t profile_size) {
+    uint64_t key = hash_parallel(data, size);
+    if (profile_size) {
+        uint64_t profile_hash = hash_parallel(profile, profile_size);
+        key = fnv1a(key, &profile_hash, sizeof(profile_hash));
+    }
+
+    int more_accurate_model = 0;
+    int no_partition_as_possible = 0;
+    int oriented = 0;
+    int degeneracy_order = 0;
+    double partition_tolerance = -1;   // negative without LOCALITY_PARTITION
+    double locality_heavy_share = -1;
+    int label_rounds = 0;
+    int dynamic_schedule = 0;
+    double split_share = -1;   // negative without SPLIT_ROOTS
+    double profile_ridge = -1;   // negative without PROFILE_MODEL
+    double hybrid_dpus = -1;   // negative without HYBRID_CPU
+#ifdef MORE_ACCURATE_MODEL
+    more_accurate_model = 1;
+#endif
+#ifdef NO_PARTITION_AS_POSSIBLE
+    no_partition_as_possible = 1;
+#endif
+#ifdef ORIENTED
+    oriented = 1;
+#endif
+#ifdef DEGENERACY_ORDER
+    degeneracy_order = 1;
+#endif
+#ifdef LOCALITY_PARTITION
+    partition_tolerance = PARTITION_TOLERANCE;
+    locality_heavy_share = LOCALITY_HEAVY_SHARE;
+    label_rounds = LABEL_ROUNDS;
+#endif
+#ifdef DYNAMIC_SCHEDULE
+    dynamic_schedule = 1;
+#endif
+#ifdef SPLIT_ROOTS
+    split_share = SPLIT_SHARE;
+#endif
+#ifdef PROFILE_MODEL
+    profile_ridge = PROFILE_RIDGE;
+#endif
+#ifdef HYBRID_CPU
+    hybrid_dpus = HYBRID_THREAD_DPUS * host_thread_num();
+#endif
+#ifdef GENERATED
+    // a spec keeps its name across edits and replans, the root lists and split ranges follow the plan
+    int lower_second = GENERATED_LOWER_SECOND;
+    key = fnv1a(key, &lower_second, sizeof(lower_second));
+    key = fnv1a(key, GENERATED_PLAN, strlen(GENERATED_PLAN));
+#endif
+    char params[256];
+    int len = snprintf(params, sizeof(params), "%s %zu %u %zu %zu %zu %zu %d %d %d %d %g %g %d %g %d %g %u %u %g", PATTERN_NAME, size, nr_dpus, (size_t)DPU_N, (size_t)DPU_M,
+                       (size_t)DPU_ROOT_NUM, (size_t)PARTITION_M, more_accurate_model, no_partition_as_possible, oriented, degeneracy_order,
+                       partition_tolerance, locality_heavy_share, label_rounds, profile_ridge, dynamic_schedule, split_share, (uint32_t)DPU_SPLIT_NUM, pattern_set, hybrid_dpus);
+    return fnv1a(key, params, len);
+}
+
+// "./data/Wiki-Vote.bin" -> CACHE_DIR "Wiki-Vote_clique3_64.cache"
+void cache_path(const char *data_path, char *path, size_t size) {
+    const char *base = strrchr(data_path, '/');
+    base = base ? base + 1 : data_path;
+    const char *ext = strrchr(base, '.');
+    int len = ext ? (int)(ext - base) : (int)strlen(base);
+    snprintf(path, size, CACHE_DIR "%.*s_" PATTERN_NAME "_%u.cache", len, base, nr_dpus);
+}
+
+static bool read_all(FILE *fp, void *buf, size_t size) {
+    return fread(buf, 1, size, fp) == size;
+}
+
+static bool write_all(FILE *fp, const void *buf, size_t size) {
+    return fwrite(buf, 1, size, fp) == size;
+}
+
+bool cache_load(const char *path, uint64_t key, Graph *g, DpuImage **images) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+    CacheHeader header;
+    if (!read_all(fp, &header, sizeof(header)) || memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) || header.key != key || header.nr_dpus != nr_dpus) {
+        fclose(fp);
+        return false;
+    }
+#ifdef MULTI_PASS
+    if (header.epoch_num == 0 || header.epoch_num > header.n + 1) {
+#else
+    if (header.epoch_num != 1) {
+#endif
+        fclose(fp);
+        return false;
+    }
+    graph_parts(g, header.epoch_num);
+    uint32_t part_num = g->part_num;
+
+    bool fine = true;
+    size_t row_size = ALIGN2(header.n + 1);
+    g->n = header.n;
+    g->m = header.m;
+    g->row_ptr = malloc((row_size + ALIGN2(header.m)) * sizeof(node_t));
+    g->col_idx = (node_t *)(g->row_ptr + row_size);
+    fine = fine && read_all(fp, g->row_ptr, (header.n + 1) * sizeof(edge_ptr));
+    fine = fine && read_all(fp, g->col_idx, header.m * sizeof(node_t));
+    fine = fine && read_all(fp, g->root_num, part_num * sizeof(uint64_t));
+    fine = fine && read_all(fp, g->spare_num, part_num * sizeof(uint64_t));
+    fine = fine && read_all(fp, g->split_num, part_num * sizeof(uint64_t));
+    uint64_t max_root_num = 0;
+    for (uint32_t i = 0; i < part_num; i++) {
+        g->roots[i] = malloc(DPU_ROOT_NUM * sizeof(node_t));
+        fine = fine && g->root_num[i] + g->spare_num[i] <= DPU_ROOT_NUM && read_all(fp, g->roots[i], (g->root_num[i] + g->spare_num[i]) * sizeof(node_t));
+        if (fine) max_root_num = MAX(max_root_num, g->root_num[i] + g->spare_num[i]);
+    }
+    for (uint32_t i = 0; i < part_num; i++) {
+        g->split_range[i] = malloc(DPU_SPLIT_NUM * 2 * sizeof(edge_ptr));
+        fine = fine && g->split_num[i] <= MIN(g->root_num[i], DPU_SPLIT_NUM) && read_all(fp, g->split_range[i], g->split_num[i] * 2 * sizeof(edge_ptr));
+    }
+    fine = fine && read_all(fp, &g->cpu_root_num, sizeof(uint64_t)) && g->cpu_root_num <= header.n;
+    if (fine) {
+        g->cpu_roots = malloc(MAX(g->cpu_root_num, 1) * sizeof(node_t));
+        fine = read_all(fp, g->cpu_roots, g->cpu_root_num * sizeof(node_t));
+    }
+
+    *images = NULL;
+    if (fine && header.compacted) {
+        uint64_t *row_sizes = malloc(part_num * sizeof(uint64_t));
+        uint64_t *col_sizes = malloc(part_num * sizeof(uint64_t));
+        fine = read_all(fp, row_sizes, part_num * sizeof(uint64_t)) && read_all(fp, col_sizes, part_num * sizeof(uint64_t));
+        uint64_t max_row_size = 0, max_col_size = 0;
+        for (uint32_t i = 0; fine && i < part_num; i++) {
+            fine = row_sizes[i] < DPU_N && col_sizes[i] <= DPU_M;
+            max_row_size = MAX(max_row_size, row_sizes[i]);
+            max_col_size = MAX(max_col_size, col_sizes[i]);
+        }
+        if (fine) {
+            *images = alloc_images(max_row_size + 1, max_col_size, max_root_num);
+            for (uint32_t i = 0; fine && i < part_num; i++) {
+                DpuImage *image = &(*images)[i];
+                image->row_size = row_sizes[i];
+                image->col_size = col_sizes[i];
+                fine = read_all(fp, image->row_ptr, (image->row_size + 1) * sizeof(edge_ptr)) && read_all(fp, image->col_idx, image->col_size * sizeof(node_t)) &&
+                       read_all(fp, image->roots, (g->root_num[i] + g->spare_num[i]) * sizeof(node_t));
+            }
+        }
+        free(row_sizes);
+        free(col_sizes);
+    }
+    fclose(fp);
+
+    if (!fine) {
+        printf("Ignoring corrupted cache %s\n", path);
+        free(g->row_ptr);
+        graph_parts(g, 1);
+        free(g->cpu_roots);
+        g->cpu_root_num = 0;
+        g->cpu_roots = NULL;
+        free_images(*images);
+        *images = NULL;
+    }
+    return fine;
+}
+
+// written to a temporary file first so an interrupted run never leaves a truncated cache behind
+void cache_store(const char *path, uint64_t key, Graph *g, DpuImage *images) {
+    char tmp_path[520];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        printf("Cannot write cache %s\n", path);
+        return;
+    }
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.key = key;
+    header.n = g->n;
+    header.m = g->m;
+    header.nr_dpus = nr_dpus;
+    header.epoch_num = g->epoch_num;
+    header.compacted = images != NULL;
+
+    bool fine = write_all(fp, &header, sizeof(header));
+    fine = fine && write_all(fp, g->row_ptr, ((size_t)g->n + 1) * sizeof(edge_ptr));
+    fine = fine && write_all(fp, g->col_idx, (size_t)g->m * sizeof(node_t));
+    fine = fine && write_all(fp, g->root_num, g->part_num * sizeof(uint64_t));
+    fine = fine && write_all(fp, g->spare_num, g->part_num * sizeof(uint64_t));
+    fine = fine && write_all(fp, g->split_num, g->part_num * sizeof(uint64_t));
+    for (uint32_t i = 0; fine && i < g->part_num; i++) {
+        fine = write_all(fp, g->roots[i], (g->root_num[i] + g->spare_num[i]) * sizeof(node_t));
+    }
+    for (uint32_t i = 0; fine && i < g->part_num; i++) {
+        fine = write_all(fp, g->split_range[i], g->split_num[i] * 2 * sizeof(edge_ptr));
+    }
+    fine = fine && write_all(fp, &g->cpu_root_num, sizeof(uint64_t)) && write_all(fp, g->cpu_roots, g->cpu_root_num * sizeof(node_t));
+    if (images) {
+        for (uint32_t i = 0; fine && i < g->part_num; i++) {
+            fine = write_all(fp, &images[i].row_size, sizeof(uint64_t));
+        }
+        for (uint32_t i = 0; fine && i < g->part_num; i++) {
+            fine = write_all(fp, &images[i].col_size, sizeof(uint64_t));
+        }
+        for (uint32_t i = 0; fine && i < g->part_num; i++) {
+            fine = write_all(fp, images[i].row_ptr, (images[i].row_size + 1) * sizeof(edge_ptr)) && write_all(fp, images[i].col_idx, images[i].col_size * sizeof(node_t)) &&
+                   write_all(fp, images[i].roots, (g->root_num[i] + g->spare_num[i]) * sizeof(node_t));
+        }
+    }
+    fine = (fclose(fp) == 0) && fine;
+    if (!fine || rename(tmp_path, path) != 0) {
+        printf("Cannot write cache %s\n", path);
+        remove(tmp_path);
+    }
+}
@@ -0,0 +1,1117 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Compile a pattern spec into the kernels of a PATTERN=GEN build. A spec names the pattern and lists its edges:
+//   # tailed triangle
+//   name tailed_triangle
+//   vertices 4
+//   edges 0-1 0-2 1-2 2-3
+// <out_dir>/generated.h describes the plan, dpu.c holds the tasklet kernel and host.c the host reference used
+// by CPU_RUN and HYBRID_CPU. Like the hand-written kernels, every subgraph is counted once, whatever its
+// automorphisms, and the subgraphs need not be induced.
+// Every matching order the dpu images can hold is tried with every set of symmetry-breaking restrictions, and
+// the schedule with the fewest expected steps on the degree statistics of the -g graph is emitted.
+
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+
+#define MIN_PATTERN_SIZE 3
+#define MAX_PATTERN_SIZE 7
+#define MAX_NAME_LEN 48
+#define KERNEL_BUF_NUM 4  // mram_buf slots of a tasklet, and MINE_BUF_NUM of a host thread
+#define NONE (-1)
+#define MAX_AUTOMORPHISMS 5040  // 7!
+#define MAX_RESTRICTION_SETS 256  // distinct restriction sets tried per matching order
+#define CLOSURE_SAMPLES (1 << 16)  // wedges sampled to estimate the closure of the -g graph
+// statistics assumed without -g, about those of a mid-sized social network
+#define DEFAULT_N 1e6
+#define DEFAULT_AVG_DEG 16.0
+#define DEFAULT_NBR_DEG 128.0
+#define DEFAULT_CLOSURE 0.05
+
+typedef struct Pattern {
+    char name[MAX_NAME_LEN];
+    uint32_t size;
+    uint32_t edge_num;
+    bool adj[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];
+} Pattern;
+
+// where the candidates of a level come from
+typedef enum SourceKind {
+    SOURCE_ROW,  // the row of one earlier level
+    SOURCE_SET,  // rows intersected, starting from the stored set of an earlier level if there is one
+    SOURCE_REUSE,  // the stored set of an earlier level as it is
+} SourceKind;
+
+// everything below is indexed by level, the position in the matching order
+typedef struct Plan {
+    uint32_t size;
+    uint32_t order[MAX_PATTERN_SIZE];  // pattern vertex matched at each level
+    bool adj[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];
+    bool less[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];  // level i gets a smaller id than level j, transitively closed, only i > j
+    uint32_t parent_num[MAX_PATTERN_SIZE];
+    uint32_t parent[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];  // earlier adjacent levels
+    uint32_t bound_num[MAX_PATTERN_SIZE];
+    uint32_t bound[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];  // earlier levels bounding the id from above, none implied by another
+    uint32_t excl_num[MAX_PATTERN_SIZE];
+    uint32_t excl[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];  // earlier levels that may be among the candidates
+    SourceKind kind[MAX_PATTERN_SIZE];
+    int source[MAX_PATTERN_SIZE];  // the row of SOURCE_ROW, the stored level of SOURCE_SET and SOURCE_REUSE or NONE
+    int prefix[MAX_PATTERN_SIZE];  // bounding level that loops over the source set, its index is the usable size
+    uint32_t rest_num[MAX_PATTERN_SIZE];
+    uint32_t rest[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];  // rows SOURCE_SET intersects
+    bool check_bound[MAX_PATTERN_SIZE];  // the source does not apply the bound already
+    uint32_t depth[MAX_PATTERN_SIZE];  // candidates are computed as soon as this level is fixed
+    int slot[MAX_PATTERN_SIZE];  // buffer of the stored candidates
+    int temp[MAX_PATTERN_SIZE][2];  // scratch buffers of the intersections
+    int iterates[MAX_PATTERN_SIZE];  // level whose stored set this level loops over, NONE for rows
+    bool row_used[MAX_PATTERN_SIZE];
+    bool vertex_used[MAX_PATTERN_SIZE];  // the id of the level is read after its loop header
+    bool uses_count_below;
+    bool uses_contains;
+    bool uses_buffers;  // any intersection, the host only needs buffers for stored and intermediate sets
+    bool host_uses_buffers;
+} Plan;
+
+// what the cost model knows about the data graph
+typedef struct GraphStats {
+    double n;
+    double avg_deg;
+    double nbr_deg;  // expected degree of a vertex reached through an edge, the sum of squared degrees over m
+    double closure;  // chance that two neighbors of a vertex are adjacent
+} GraphStats;
+
+// state of the schedule search
+typedef struct Search {
+    const Pattern *p;
+    uint8_t (*autos)[MAX_PATTERN_SIZE];
+    uint32_t auto_num;
+    const GraphStats *stats;
+    bool verbose;
+    uint8_t pos[MAX_PATTERN_SIZE];  // level of each pattern vertex in the current order
+    Plan plan;
+    uint32_t seen_num;
+    bool seen[MAX_RESTRICTION_SETS][MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];  // restriction sets of the current order
+    uint32_t schedule_num;  // schedules that fit the buffers
+    double best_cost;
+    Plan best;
+} Search;
+
+static const char *const vertex_names[MAX_PATTERN_SIZE] = {"root", "second_root", "third_root", "fourth_root", "fifth_root", "sixth_root", "seventh_root"};
+static const char index_names[MAX_PATTERN_SIZE] = {0, 'i', 'j', 'k', 'l', 'm', 0};  // loop index of each level
+
+static void fail(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, ANSI_COLOR_RED "Error: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n" ANSI_COLOR_RESET);
+    va_end(args);
+    exit(1);
+}
+
+static void read_spec(const char *path, Pattern *p) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) fail("cannot open %s", path);
+    memset(p, 0, sizeof(Pattern));
+    char line[1024];
+    bool in_edges = false;
+    while (fgets(line, sizeof(line), fp)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *save = NULL;
+        char *token = strtok_r(line, " \t\r\n", &save);
+        if (!token) continue;
+        if (!strcmp(token, "name")) {
+            char *name = strtok_r(NULL, " \t\r\n", &save);
+            if (!name || strlen(name) >= MAX_NAME_LEN) fail("%s: name needs up to %d characters", path, MAX_NAME_LEN - 1);
+            for (char *c = name; *c; c++) {
+                if (!(islower((unsigned char)*c) || *c == '_' || (c != name && isdigit((unsigned char)*c)))) fail("%s: name %s is not a lowercase identifier", path, name);
+            }
+            strcpy(p->name, name);
+            in_edges = false;
+            continue;
+        }
+        if (!strcmp(token, "vertices")) {
+            char *num = strtok_r(NULL, " \t\r\n", &save);
+            p->size = num ? (uint32_t)strtoul(num, NULL, 10) : 0;
+            if (p->size < MIN_PATTERN_SIZE || p->size > MAX_PATTERN_SIZE) fail("%s: %d to %d vertices are supported", path, MIN_PATTERN_SIZE, MAX_PATTERN_SIZE);
+            in_edges = false;
+            continue;
+        }
+        if (!strcmp(token, "edges")) {
+            in_edges = true;
+            token = strtok_r(NULL, " \t\r\n", &save);
+        }
+        if (!in_edges) fail("%s: unknown key %s", path, token);
+        for (; token; token = strtok_r(NULL, " \t\r\n", &save)) {
+            unsigned a, b;
+            char tail;
+            if (sscanf(token, "%u-%u%c", &a, &b, &tail) != 2) fail("%s: edge %s is not a-b", path, token);
+            if (!p->size) fail("%s: vertices must come before edges", path);
+            if (a >= p->size || b >= p->size || a == b) fail("%s: edge %s is out of range or a loop", path, token);
+            if (!p->adj[a][b]) p->edge_num++;
+            p->adj[a][b] = p->adj[b][a] = true;
+        }
+    }
+    fclose(fp);
+    if (!p->name[0] || !p->size) fail("%s: name and vertices are required", path);
+
+    // connected, or the levels cannot all be reached through rows
+    bool seen[MAX_PATTERN_SIZE] = {true};
+    uint32_t stack[MAX_PATTERN_SIZE] = {0}, top = 1, reached = 1;
+    while (top) {
+        uint32_t u = stack[--top];
+        for (uint32_t v = 0; v < p->size; v++) {
+            if (p->adj[u][v] && !seen[v]) {
+                seen[v] = true;
+                stack[top++] = v;
+                reached++;
+            }
+        }
+    }
+    if (reached != p->size) fail("%s: the pattern is not connected", path);
+}
+
+static uint64_t next_random(uint64_t *state) {
+    // splitmix64, seeded the same every run so that a graph always gives the same plan
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// degree statistics of a .bin graph (n, m, row_ptr[n], col_idx[m]), the closure from wedges sampled in
+// proportion to their number at each vertex
+static void read_graph_stats(const char *path, GraphStats *stats) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) fail("cannot open %s", path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < 2 * sizeof(uint32_t)) fail("bad header in %s", path);
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) fail("cannot map %s", path);
+    const uint32_t *header = addr;
+    uint32_t n = header[0], m = header[1];
+    const uint32_t *row_ptr = header + 2;
+    const uint32_t *col_idx = row_ptr + n;
+    if (!n || !m || (size_t)st.st_size < (2 + (size_t)n + m) * sizeof(uint32_t)) fail("truncated or empty graph %s", path);
+
+    uint64_t *wedges = malloc((size_t)n * sizeof(uint64_t));  // inclusive prefix sums
+    uint64_t wedge_sum = 0;
+    double square_sum = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        double deg = (v + 1 < n ? row_ptr[v + 1] : m) - row_ptr[v];
+        square_sum += deg * deg;
+        wedge_sum += (uint64_t)(deg * (deg - 1));
+        wedges[v] = wedge_sum;
+    }
+    stats->n = n;
+    stats->avg_deg = (double)m / n;
+    stats->nbr_deg = square_sum / m;
+    stats->closure = 0;
+    if (wedge_sum) {
+        uint64_t state = 0, closed = 0;
+        for (uint32_t t = 0; t < CLOSURE_SAMPLES; t++) {
+            uint64_t r = next_random(&state) % wedge_sum;
+            uint32_t l = 0, h = n - 1;
+            while (l < h) {
+                uint32_t mid = l + (h - l) / 2;
+                if (wedges[mid] > r) h = mid;
+                else l = mid + 1;
+            }
+            uint32_t begin = row_ptr[l], deg = (l + 1 < n ? row_ptr[l + 1] : m) - begin;
+            uint32_t a = next_random(&state) % deg, b = next_random(&state) % (deg - 1);
+            if (b >= a) b++;
+            uint32_t u = col_idx[begin + a], w = col_idx[begin + b];
+            uint32_t lo = row_ptr[u], hi = u + 1 < n ? row_ptr[u + 1] : m;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (col_idx[mid] < w) lo = mid + 1;
+                else hi = mid;
+            }
+            closed += lo < (u + 1 < n ? row_ptr[u + 1] : m) && col_idx[lo] == w;
+        }
+        stats->closure = (double)closed / CLOSURE_SAMPLES;
+    }
+    free(wedges);
+    munmap(addr, st.st_size);
+}
+
+static uint32_t degree(const Pattern *p, uint32_t u) {
+    uint32_t deg = 0;
+    for (uint32_t v = 0; v < p->size; v++) {
+        deg += p->adj[u][v];
+    }
+    return deg;
+}
+
+static void find_automorphisms(const Pattern *p, uint8_t *perm, bool *used, uint32_t u, uint8_t (*autos)[MAX_PATTERN_SIZE], uint32_t *auto_num) {
+    if (u == p->size) {
+        memcpy(autos[(*auto_num)++], perm, MAX_PATTERN_SIZE);
+        return;
+    }
+    for (uint32_t v = 0; v < p->size; v++) {
+        if (used[v] || degree(p, u) != degree(p, v)) continue;
+        bool fit = true;
+        for (uint32_t w = 0; w < u && fit; w++) {
+            fit = p->adj[u][w] == p->adj[v][perm[w]];
+        }
+        if (!fit) continue;
+        perm[u] = v;
+        used[v] = true;
+        find_automorphisms(p, perm, used, u + 1, autos, auto_num);
+        used[v] = false;
+    }
+}
+
+// the dpu images only hold the rows of a root and of its neighbors, so the vertices not adjacent to the
+// root must not be adjacent to each other: one of them would have to be intersected with
+static bool root_fits(const Pattern *p, uint32_t root) {
+    for (uint32_t u = 0; u < p->size; u++) {
+        for (uint32_t v = 0; v < p->size; v++) {
+            if (u != root && v != root && p->adj[u][v] && !p->adj[root][u] && !p->adj[root][v]) return false;
+        }
+    }
+    return true;
+}
+
+static bool subset(const uint32_t *a, uint32_t a_num, const uint32_t *b, uint32_t b_num) {
+    for (uint32_t i = 0; i < a_num; i++) {
+        bool found = false;
+        for (uint32_t j = 0; j < b_num && !found; j++) {
+            found = a[i] == b[j];
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+static int alloc_buf(bool *used) {
+    for (int i = 0; i < KERNEL_BUF_NUM; i++) {
+        if (!used[i]) {
+            used[i] = true;
+            return i;
+        }
+    }
+    return NONE;
+}
+
+// candidate sets of every level: a single row is looped over as it is, more rows are intersected once all
+// the levels they depend on are fixed, starting from a stored set of an earlier level when one covers them.
+// false if the sets need more buffers than a tasklet has
+static bool plan_sets(Plan *plan) {
+    uint32_t n = plan->size;
+    for (uint32_t i = 1; i < n; i++) {
+        plan->parent_num[i] = plan->bound_num[i] = plan->excl_num[i] = 0;
+        for (uint32_t j = 0; j < i; j++) {
+            if (plan->adj[i][j]) plan->parent[i][plan->parent_num[i]++] = j;
+            else if (!plan->less[i][j]) plan->excl[i][plan->excl_num[i]++] = j;
+            if (!plan->less[i][j]) continue;
+            bool implied = false;
+            for (uint32_t k = 0; k < i && !implied; k++) {
+                implied = plan->less[i][k] && plan->less[k][j];
+            }
+            if (!implied) plan->bound[i][plan->bound_num[i]++] = j;
+        }
+    }
+
+    memset(plan->row_used, 0, sizeof(plan->row_used));
+    memset(plan->vertex_used, 0, sizeof(plan->vertex_used));
+    for (uint32_t i = 0; i < n; i++) {
+        plan->slot[i] = plan->temp[i][0] = plan->temp[i][1] = plan->prefix[i] = plan->iterates[i] = NONE;
+        plan->rest_num[i] = 0;
+        plan->check_bound[i] = false;
+        plan->depth[i] = 1;
+    }
+    plan->kind[1] = SOURCE_ROW;
+    plan->source[1] = 0;
+    plan->check_bound[1] = plan->bound_num[1] > 0;
+    for (uint32_t i = 2; i < n; i++) {
+        for (uint32_t j = 0; j < plan->parent_num[i]; j++) {
+            plan->row_used[plan->parent[i][j]] = true;
+            plan->depth[i] = plan->parent[i][j] > plan->depth[i] ? plan->parent[i][j] : plan->depth[i];
+        }
+        for (uint32_t j = 0; j < plan->bound_num[i]; j++) {
+            plan->depth[i] = plan->bound[i][j] > plan->depth[i] ? plan->bound[i][j] : plan->depth[i];
+        }
+        if (plan->parent_num[i] == 1) {
+            plan->kind[i] = SOURCE_ROW;
+            plan->source[i] = plan->parent[i][0];
+            plan->check_bound[i] = plan->bound_num[i] > 0;
+            continue;
+        }
+
+        // the stored set sharing the most rows, its own bounds must hold for this level as well
+        int best = NONE, best_prefix = NONE;
+        for (uint32_t l = 2; l < i; l++) {
+            if (plan->kind[l] != SOURCE_SET || l == n - 1) continue;
+            if (!subset(plan->parent[l], plan->parent_num[l], plan->parent[i], plan->parent_num[i])) continue;
+            bool holds = true;
+            for (uint32_t j = 0; j < plan->bound_num[l] && holds; j++) {
+                holds = plan->less[i][plan->bound[l][j]];
+            }
+            if (!holds) continue;
+            int prefix = NONE;
+            for (uint32_t j = 0; j < plan->bound_num[i]; j++) {
+                if (plan->iterates[plan->bound[i][j]] == (int)l) prefix = plan->bound[i][j];
+            }
+            if (best == NONE || plan->parent_num[l] > plan->parent_num[best] || (plan->parent_num[l] == plan->parent_num[best] && (prefix != NONE || best_prefix == NONE))) {
+                best = l;
+                best_prefix = prefix;
+            }
+        }
+        plan->source[i] = best;
+        plan->prefix[i] = best_prefix;
+        for (uint32_t j = 0; j < plan->parent_num[i]; j++) {
+            uint32_t parent = plan->parent[i][j];
+            if (best == NONE || !subset(&parent, 1, plan->parent[best], plan->parent_num[best])) plan->rest[i][plan->rest_num[i]++] = parent;
+        }
+        if (plan->rest_num[i]) {
+            plan->kind[i] = SOURCE_SET;
+        }
+        else {
+            // the bound is already applied if the stored set or the prefix implies each part of it
+            plan->kind[i] = SOURCE_REUSE;
+            for (uint32_t j = 0; j < plan->bound_num[i]; j++) {
+                uint32_t b = plan->bound[i][j];
+                bool implied = (int)b == best_prefix;
+                for (uint32_t k = 0; k < plan->bound_num[best] && !implied; k++) {
+                    uint32_t c = plan->bound[best][k];
+                    implied = c == b || plan->less[c][b];
+                }
+                plan->check_bound[i] |= !implied;
+            }
+        }
+        if (i < n - 1) plan->iterates[i] = plan->kind[i] == SOURCE_SET ? (int)i : best;
+    }
+
+    // ids read after the loop headers: bounds that the source does not apply already, exclusions, rows
+    for (uint32_t i = 1; i < n; i++) {
+        bool last_excl = i == n - 1 && plan->excl_num[i];
+        if (plan->kind[i] == SOURCE_SET || plan->check_bound[i] || last_excl) {
+            for (uint32_t j = 0; j < plan->bound_num[i]; j++) {
+                plan->vertex_used[plan->bound[i][j]] = true;
+            }
+        }
+        for (uint32_t j = 0; j < plan->excl_num[i]; j++) {
+            uint32_t excl = plan->excl[i][j];
+            bool used = i < n - 1 || plan->bound_num[i];
+            for (uint32_t k = 0; k < plan->parent_num[i]; k++) {
+                used |= !plan->adj[excl][plan->parent[i][k]];
+            }
+            plan->vertex_used[excl] |= used;
+        }
+    }
+
+    // buffers in the order the kernel computes the sets.  every loop nests in the one before, so a stored set
+    // stays alive to the end and only the scratch buffers of an intersection are given back
+    bool used[KERNEL_BUF_NUM] = {false};
+    plan->uses_count_below = plan->uses_contains = plan->uses_buffers = plan->host_uses_buffers = false;
+    for (uint32_t depth = 1; depth < n - 1; depth++) {
+        for (uint32_t i = depth + 1; i < n; i++) {
+            if (plan->depth[i] != depth) continue;
+            if (i == n - 1 && plan->check_bound[i]) plan->uses_count_below = true;
+            if (plan->kind[i] != SOURCE_SET) continue;
+            uint32_t steps = plan->rest_num[i] - (plan->source[i] == NONE);
+            if (i < n - 1) {
+                plan->slot[i] = alloc_buf(used);
+                if (plan->slot[i] == NONE) return false;
+                if (steps > 1 && (plan->temp[i][0] = alloc_buf(used)) == NONE) return false;
+            }
+            else {
+                plan->temp[i][0] = alloc_buf(used);
+                if (plan->temp[i][0] == NONE) return false;
+                if (steps > 1 && (plan->temp[i][1] = alloc_buf(used)) == NONE) return false;
+            }
+            for (uint32_t t = 0; t < 2; t++) {
+                if (plan->temp[i][t] != NONE) used[plan->temp[i][t]] = false;
+            }
+            plan->uses_buffers = true;
+            plan->host_uses_buffers |= i < n - 1 || steps > 1;
+        }
+    }
+    for (uint32_t j = 0; j < plan->excl_num[n - 1]; j++) {
+        for (uint32_t k = 0; k < plan->parent_num[n - 1]; k++) {
+            if (!plan->adj[plan->excl[n - 1][j]][plan->parent[n - 1][k]]) plan->uses_contains = true;
+        }
+    }
+    return true;
+}
+
+// expected steps of the whole search in the style of GraphPi: a candidate set is nbr_deg long, shrinks by the
+// closure for every further row it is intersected with, and the restrictions keep the share of id orders of
+// the levels so far they allow.  loops cost a step per candidate, intersections a step per element merged and
+// the last level a lookup per match of the levels before it
+static double plan_cost(const Plan *plan, const GraphStats *stats) {
+    uint32_t n = plan->size;
+    double size[MAX_PATTERN_SIZE], matches[MAX_PATTERN_SIZE];
+    // orders of a set of levels by id that the restrictions allow, built up from its largest level
+    double orders[1 << MAX_PATTERN_SIZE] = {1};
+    for (uint32_t set = 1; set < (1u << n); set++) {
+        orders[set] = 0;
+        for (uint32_t x = 0; x < n; x++) {
+            if (!(set >> x & 1)) continue;
+            bool largest = true;
+            for (uint32_t y = 0; y < n && largest; y++) {
+                largest = !(set >> y & 1) || !plan->less[x][y];
+            }
+            if (largest) orders[set] += orders[set & ~(1u << x)];
+        }
+    }
+    double permutations = 1, product = stats->n;
+    matches[0] = stats->n;
+    for (uint32_t i = 1; i < n; i++) {
+        size[i] = i == 1 ? stats->avg_deg : stats->nbr_deg * pow(stats->closure, plan->parent_num[i] - 1);
+        permutations *= i + 1;
+        product *= size[i];
+        matches[i] = product * orders[(1u << (i + 1)) - 1] / permutations;
+    }
+
+    double cost = 0;
+    for (uint32_t i = 1; i < n - 1; i++) {
+        cost += matches[i];
+    }
+    for (uint32_t i = 2; i < n; i++) {
+        if (plan->kind[i] != SOURCE_SET) continue;
+        double set = plan->source[i] == NONE ? stats->nbr_deg : size[plan->source[i]], merged = 0;
+        for (uint32_t j = plan->source[i] == NONE; j < plan->rest_num[i]; j++) {
+            merged += set + stats->nbr_deg;
+            set *= stats->closure;
+        }
+        cost += matches[plan->depth[i]] * merged;
+    }
+    double lookup = 1;
+    if (plan->kind[n - 1] != SOURCE_SET && plan->check_bound[n - 1]) lookup += log2(size[n - 1] + 1);
+    for (uint32_t j = 0; j < plan->excl_num[n - 1]; j++) {
+        for (uint32_t k = 0; k < plan->parent_num[n - 1]; k++) {
+            if (!plan->adj[plan->excl[n - 1][j]][plan->parent[n - 1][k]]) lookup += log2(stats->nbr_deg + 1);
+        }
+    }
+    return cost + matches[n - 2] * lookup;
+}
+
+static void print_schedule(const Plan *plan, double cost) {
+    printf("  order");
+    for (uint32_t i = 0; i < plan->size; i++) {
+        printf(" %u", plan->order[i]);
+    }
+    printf(", restrictions");
+    bool any = false;
+    for (uint32_t i = 1; i < plan->size; i++) {
+        for (uint32_t j = 0; j < plan->bound_num[i]; j++) {
+            printf(" %u<%u", plan->order[i], plan->order[plan->bound[i][j]]);
+            any = true;
+        }
+    }
+    printf("%s, cost %.4g\n", any ? "" : " none", cost);
+}
+
+// symmetry breaking as in GraphZero: a level with a non-trivial orbit under the automorphisms left gets a
+// larger id than the rest of its orbit, and only the automorphisms fixing it are kept.  any such level works,
+// as long as its orbit lies after it, so that every restriction is an upper bound set by an earlier level
+static void search_restrictions(Search *s, const bool *alive, bool (*less)[MAX_PATTERN_SIZE]) {
+    Plan *plan = &s->plan;
+    uint32_t n = plan->size;
+    bool done = true;
+    for (uint32_t level = 0; level < n; level++) {
+        bool moved = false, later = true;
+        for (uint32_t a = 0; a < s->auto_num; a++) {
+            if (!alive[a]) continue;
+            uint32_t image = s->pos[s->autos[a][plan->order[level]]];
+            moved |= image != level;
+            later &= image >= level;
+        }
+        if (!moved) continue;
+        done = false;
+        if (!later) continue;
+        bool next_alive[MAX_AUTOMORPHISMS];
+        bool next_less[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE];
+        memcpy(next_less, less, sizeof(next_less));
+        for (uint32_t a = 0; a < s->auto_num; a++) {
+            uint32_t image = s->pos[s->autos[a][plan->order[level]]];
+            next_alive[a] = alive[a] && image == level;
+            if (alive[a] && image != level) next_less[image][level] = true;
+        }
+        search_restrictions(s, next_alive, next_less);
+    }
+    if (!done) return;
+
+    memcpy(plan->less, less, sizeof(plan->less));
+    for (uint32_t k = 0; k < n; k++) {
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t j = 0; j < n; j++) {
+                if (plan->less[i][k] && plan->less[k][j]) plan->less[i][j] = true;
+            }
+        }
+    }
+    // the choices are tried in every order, most lead to a restriction set seen before
+    for (uint32_t i = 0; i < s->seen_num; i++) {
+        if (!memcmp(s->seen[i], plan->less, sizeof(plan->less))) return;
+    }
+    if (s->seen_num < MAX_RESTRICTION_SETS) memcpy(s->seen[s->seen_num++], plan->less, sizeof(plan->less));
+    if (!plan_sets(plan)) return;
+    s->schedule_num++;
+    double cost = plan_cost(plan, s->stats);
+    if (s->verbose) print_schedule(plan, cost);
+    if (cost < s->best_cost) {
+        s->best_cost = cost;
+        s->best = *plan;
+    }
+}
+
+// every order the dpu images can hold: the root's non-neighbors are independent, every level is adjacent to
+// an earlier one, and a vertex off the root's neighborhood waits until all its neighbors are placed, so
+// nothing intersects its row
+static void search_orders(Search *s, uint32_t level, bool *placed) {
+    const Pattern *p = s->p;
+    Plan *plan = &s->plan;
+    if (level == p->size) {
+        for (uint32_t i = 0; i < p->size; i++) {
+            for (uint32_t j = 0; j < p->size; j++) {
+                plan->adj[i][j] = p->adj[plan->order[i]][plan->order[j]];
+            }
+        }
+        bool alive[MAX_AUTOMORPHISMS];
+        bool less[MAX_PATTERN_SIZE][MAX_PATTERN_SIZE] = {{false}};
+        for (uint32_t a = 0; a < s->auto_num; a++) {
+            alive[a] = true;
+        }
+        s->seen_num = 0;
+        search_restrictions(s, alive, less);
+        return;
+    }
+    uint32_t root = plan->order[0];
+    for (uint32_t u = 0; u < p->size; u++) {
+        if (placed[u]) continue;
+        if (level == 0) {
+            if (!root_fits(p, u)) continue;
+        }
+        else {
+            bool linked = false, ready = true;
+            for (uint32_t v = 0; v < p->size; v++) {
+                if (!p->adj[u][v]) continue;
+                if (placed[v]) linked = true;
+                else ready = false;
+            }
+            if (!linked || (!p->adj[root][u] && !ready)) continue;
+        }
+        plan->order[level] = u;
+        s->pos[u] = level;
+        placed[u] = true;
+        search_orders(s, level + 1, placed);
+        placed[u] = false;
+    }
+}
+
+// product of the loop sizes under the analytic model of partition.c: rows of the root are deg long, or eff_deg
+// below the root, any other candidate set avg_deg, and an intersection at the last level scans about as much
+static void plan_workload(const Plan *plan, char *out, size_t size) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (uint32_t i = 1; i < plan->size; i++) {
+        const char *factor;
+        bool from_root = false;
+        for (uint32_t j = 0; j < plan->parent_num[i]; j++) {
+            from_root |= plan->parent[i][j] == 0;
+        }
+        if (i == plan->size - 1 && plan->kind[i] != SOURCE_SET) break;
+        if (from_root) factor = plan->less[i][0] && i < plan->size - 1 ? "eff_deg" : "deg";
+        else factor = "avg_deg";
+        len += snprintf(out + len, size - len, "%s%s", len ? " * " : "", factor);
+    }
+}
+
+static void describe(FILE *fp, const Plan *plan, uint32_t i) {
+    fprintf(fp, "//   %s = vertex %u", vertex_names[i], plan->order[i]);
+    if (i == 0) {
+        fprintf(fp, "\n");
+        return;
+    }
+    fprintf(fp, ", in");
+    for (uint32_t j = 0; j < plan->parent_num[i]; j++) {
+        fprintf(fp, "%s N(%s)", j ? " &" : "", vertex_names[plan->parent[i][j]]);
+    }
+    for (uint32_t j = 0; j < plan->bound_num[i]; j++) {
+        fprintf(fp, "%s %s", j ? "," : ", below", vertex_names[plan->bound[i][j]]);
+    }
+    for (uint32_t j = 0; j < plan->excl_num[i]; j++) {
+        fprintf(fp, "%s %s", j ? "," : ", not", vertex_names[plan->excl[i][j]]);
+    }
+    if (plan->kind[i] == SOURCE_ROW && i == plan->size - 1) fprintf(fp, ", counted");
+    else if (plan->kind[i] == SOURCE_SET && plan->source[i] != NONE) fprintf(fp, ", from the set of %s", vertex_names[plan->source[i]]);
+    else if (plan->kind[i] == SOURCE_REUSE) fprintf(fp, ", the set of %s", vertex_names[plan->source[i]]);
+    if (plan->prefix[i] != NONE) fprintf(fp, " before %s", vertex_names[plan->prefix[i]]);
+    if (plan->kind[i] != SOURCE_ROW) fprintf(fp, ", after %s", vertex_names[plan->depth[i]]);
+    fprintf(fp, "\n");
+}
+
+typedef struct Emitter {
+    FILE *fp;
+    const Plan *plan;
+    bool dpu;
+} Emitter;
+
+static void emit(Emitter *e, int indent, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(e->fp, "%*s", indent * 4, "");
+    vfprintf(e->fp, fmt, args);
+    fprintf(e->fp, "\n");
+    va_end(args);
+}
+
+static const char *dma(const Emitter *e) {
+    return e->dpu ? "  // intended DMA" : "";
+}
+
+static void row_of(const Emitter *e, uint32_t level, char *ptr, char *size) {
+    const char *v = vertex_names[level];
+    sprintf(ptr, "&%scol_idx[%s_begin]", e->dpu ? "" : "g->", v);
+    sprintf(size, "%s_end - %s_begin", v, v);
+}
+
+static void buf_of(const Emitter *e, int slot, char *out) {
+    static const char *const dpu_slots[KERNEL_BUF_NUM] = {"tasklet_id", "tasklet_id + NR_TASKLETS", "tasklet_id + (NR_TASKLETS << 1)", "tasklet_id + NR_TASKLETS * 3"};
+    if (e->dpu) sprintf(out, "mram_buf[%s]", dpu_slots[slot]);
+    else sprintf(out, "buf[%d]", slot);
+}
+
+// the stored set a level starts from, cut before the bounding level that loops over it
+static void set_of(const Emitter *e, uint32_t i, char *ptr, char *size) {
+    const Plan *plan = e->plan;
+    buf_of(e, plan->slot[plan->source[i]], ptr);
+    if (plan->prefix[i] != NONE) sprintf(size, "%c", index_names[plan->prefix[i]]);
+    else sprintf(size, "%s_size", vertex_names[plan->source[i]]);
+}
+
+static void bound_of(const Plan *plan, uint32_t i, char *out) {
+    uint32_t num = plan->bound_num[i];
+    if (!num) {
+        strcpy(out, "INVALID_NODE");
+        return;
+    }
+    out[0] = '\0';
+    for (uint32_t j = 0; j + 1 < num; j++) {
+        sprintf(out + strlen(out), "MIN(%s, ", vertex_names[plan->bound[i][j]]);
+    }
+    strcat(out, vertex_names[plan->bound[i][num - 1]]);
+    for (uint32_t j = 0; j + 1 < num; j++) {
+        strcat(out, ")");
+    }
+}
+
+static void emit_rows(Emitter *e, int indent, uint32_t level) {
+    const char *v = vertex_names[level];
+    emit(e, indent, "edge_ptr %s_begin = %srow_ptr[%s];%s", v, e->dpu ? "" : "g->", v, dma(e));
+    emit(e, indent, "edge_ptr %s_end = %srow_ptr[%s + 1];%s", v, e->dpu ? "" : "g->", v, dma(e));
+}
+
+static void emit_intersect(Emitter *e, int indent, const char *lhs, const char *a, const char *a_size, const char *b, const char *b_size, int out, const char *bound, bool count) {
+    char c[128];
+    bool bounded = strcmp(bound, "INVALID_NODE");
+    if (e->dpu) {
+        buf_of(e, out, c);
+        emit(e, indent, "%s = intersect_seq_buf_thresh(tasklet_buf, %s, %s, %s, %s, %s, %s);", lhs, a, a_size, b, b_size, c, bound);
+    }
+    else if (count) {
+        if (bounded) emit(e, indent, "%s = intersect_count_below(%s, %s, %s, %s, %s);", lhs, a, a_size, b, b_size, bound);
+        else emit(e, indent, "%s = intersect_count(%s, %s, %s, %s);", lhs, a, a_size, b, b_size);
+    }
+    else {
+        buf_of(e, out, c);
+        if (bounded) emit(e, indent, "%s = intersect_below(%s, %s, %s, %s, %s, %s);", lhs, a, a_size, b, b_size, bound, c);
+        else emit(e, indent, "%s = intersect(%s, %s, %s, %s, %s);", lhs, a, a_size, b, b_size, c);
+    }
+}
+
+// candidates of level i, or only their number at the last level
+static void emit_compute(Emitter *e, int indent, uint32_t i) {
+    const Plan *plan = e->plan;
+    uint32_t n = plan->size;
+    const char *v = vertex_names[i];
+    char lhs[64], a[128], a_size[128], b[128], b_size[128], bound[128];
+    bound_of(plan, i, bound);
+    sprintf(lhs, "node_t %s_size", v);
+    if (plan->kind[i] == SOURCE_ROW) {
+        row_of(e, plan->source[i], a, a_size);
+        if (plan->check_bound[i]) emit(e, indent, "%s = count_below(%s, %s, %s);", lhs, a, a_size, bound);
+        else emit(e, indent, "%s = %s;", lhs, a_size);
+    }
+    else if (plan->kind[i] == SOURCE_REUSE) {
+        set_of(e, i, a, a_size);
+        if (plan->check_bound[i]) emit(e, indent, "%s = count_below(%s, %s, %s);", lhs, a, a_size, bound);
+        else emit(e, indent, "%s = %s;", lhs, a_size);
+    }
+    else {
+        uint32_t next = 0;
+        if (plan->source[i] == NONE) row_of(e, plan->rest[i][next++], a, a_size);
+        else set_of(e, i, a, a_size);
+        uint32_t steps = plan->rest_num[i] - next;
+        for (uint32_t s = 0; s < steps; s++) {
+            row_of(e, plan->rest[i][next++], b, b_size);
+            bool last = s + 1 == steps;
+            int out;
+            if (i < n - 1) out = (steps - 1 - s) % 2 ? plan->temp[i][0] : plan->slot[i];
+            else out = last ? plan->temp[i][(steps - 1) % 2] : plan->temp[i][s % 2];
+            emit_intersect(e, indent, lhs, a, a_size, b, b_size, out, bound, i == n - 1 && last);
+            buf_of(e, out, a);
+            sprintf(a_size, "%s_size", v);
+            sprintf(lhs, "%s_size", v);
+        }
+    }
+    // nothing to match below an empty set
+    if (plan->kind[i] == SOURCE_SET && (i < n - 1 || plan->depth[i] < n - 2)) {
+        if (e->dpu && plan->depth[i] == 1) emit(e, indent, "if (!%s_size) return 0;", v);
+        else emit(e, indent, "if (!%s_size) continue;", v);
+    }
+}
+
+static void emit_level(Emitter *e, int indent, uint32_t level) {
+    const Plan *plan = e->plan;
+    uint32_t n = plan->size;
+    for (uint32_t i = level; i < n; i++) {
+        if (plan->depth[i] == level - 1 && (plan->kind[i] == SOURCE_SET || i == n - 1)) emit_compute(e, indent, i);
+    }
+    const char *v = vertex_names[level];
+    char ptr[128], size[128], bound[128];
+    bound_of(plan, level, bound);
+    if (level == n - 1) {
+        // an excluded level adjacent to a parent is always in that parent's row
+        uint32_t always = 0;
+        fprintf(e->fp, "%*sans += %s_size", indent * 4, "", v);
+        for (uint32_t j = 0; j < plan->excl_num[level]; j++) {
+            uint32_t excl = plan->excl[level][j];
+            bool open = false;
+            if (plan->bound_num[level]) {
+                fprintf(e->fp, " - (%s < %s", vertex_names[excl], bound);
+                open = true;
+            }
+            for (uint32_t k = 0; k < plan->parent_num[level]; k++) {
+                if (plan->adj[excl][plan->parent[level][k]]) continue;
+                row_of(e, plan->parent[level][k], ptr, size);
+                fprintf(e->fp, "%scontains(%s, %s, %s)", open ? " && " : " - (", ptr, size, vertex_names[excl]);
+                open = true;
+            }
+            if (open) fprintf(e->fp, ")");
+            else always++;
+        }
+        if (always) fprintf(e->fp, " - %u", always);
+        fprintf(e->fp, ";\n");
+        return;
+    }
+    char index = index_names[level];
+    bool fetch = plan->vertex_used[level] || plan->row_used[level] || plan->check_bound[level] || plan->excl_num[level];
+    if (plan->kind[level] == SOURCE_ROW) {
+        const char *row = vertex_names[plan->source[level]];
+        emit(e, indent, "for (edge_ptr %c = %s_begin; %c < %s_end; %c++) {", index, row, index, row, index);
+        if (fetch) emit(e, indent + 1, "node_t %s = %scol_idx[%c];%s", v, e->dpu ? "" : "g->", index, dma(e));
+    }
+    else {
+        if (plan->kind[level] == SOURCE_SET) {
+            buf_of(e, plan->slot[level], ptr);
+            sprintf(size, "%s_size", v);
+        }
+        else {
+            set_of(e, level, ptr, size);
+        }
+        emit(e, indent, "for (node_t %c = 0; %c < %s; %c++) {", index, index, size, index);
+        if (fetch) emit(e, indent + 1, "node_t %s = %s[%c];%s", v, ptr, index, dma(e));
+    }
+    if (plan->check_bound[level]) emit(e, indent + 1, "if (%s >= %s) break;", v, bound);
+    for (uint32_t j = 0; j < plan->excl_num[level]; j++) {
+        emit(e, indent + 1, "if (%s == %s) continue;", v, vertex_names[plan->excl[level][j]]);
+    }
+    if (plan->row_used[level]) emit_rows(e, indent + 1, level);
+    emit_level(e, indent + 1, level + 1);
+    emit(e, indent, "}");
+}
+
+static void emit_helpers(Emitter *e) {
+    const Plan *plan = e->plan;
+    const char *set = e->dpu ? "node_t __mram_ptr *" : "const node_t *";
+    if (plan->uses_count_below) {
+        emit(e, 0, "// entries of the sorted set a below bound");
+        emit(e, 0, "static node_t count_below(%sa, node_t size, node_t bound) {", set);
+        emit(e, 1, "node_t l = 0, r = size;");
+        emit(e, 1, "while (l < r) {");
+        emit(e, 2, "node_t mid = (l + r) >> 1;");
+        emit(e, 2, "if (a[mid] < bound) {%s", dma(e));
+        emit(e, 3, "l = mid + 1;");
+        emit(e, 2, "}");
+        emit(e, 2, "else {");
+        emit(e, 3, "r = mid;");
+        emit(e, 2, "}");
+        emit(e, 1, "}");
+        emit(e, 1, "return l;");
+        emit(e, 0, "}");
+        emit(e, 0, "");
+    }
+    if (plan->uses_contains) {
+        emit(e, 0, "static bool contains(%sa, node_t size, node_t x) {", set);
+        emit(e, 1, "node_t l = 0, r = size;");
+        emit(e, 1, "while (l < r) {");
+        emit(e, 2, "node_t mid = (l + r) >> 1;");
+        emit(e, 2, "node_t val = a[mid];%s", dma(e));
+        emit(e, 2, "if (val == x) return true;");
+        emit(e, 2, "if (val < x) {");
+        emit(e, 3, "l = mid + 1;");
+        emit(e, 2, "}");
+        emit(e, 2, "else {");
+        emit(e, 3, "r = mid;");
+        emit(e, 2, "}");
+        emit(e, 1, "}");
+        emit(e, 1, "return false;");
+        emit(e, 0, "}");
+        emit(e, 0, "");
+    }
+}
+
+static FILE *open_output(const char *dir, const char *file) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *fp = fopen(path, "w");
+    if (!fp) fail("cannot write %s", path);
+    return fp;
+}
+
+static void write_header(const char *dir, const char *spec, const Search *s) {
+    const Pattern *p = s->p;
+    const Plan *plan = &s->best;
+    const GraphStats *stats = s->stats;
+    FILE *fp = open_output(dir, "generated.h");
+    char workload[256];
+    plan_workload(plan, workload, sizeof(workload));
+    fprintf(fp, "// generated by bin/codegen from %s, do not edit\n", spec);
+    fprintf(fp, "#ifndef GENERATED_H\n#define GENERATED_H\n\n");
+    fprintf(fp, "// %s: %u vertices, %u edges, matched in this order:\n", p->name, p->size, p->edge_num);
+    for (uint32_t i = 0; i < plan->size; i++) {
+        describe(fp, plan, i);
+    }
+    fprintf(fp, "// cheapest of %u schedules, %.4g steps for n %.0f, avg_deg %.2f, nbr_deg %.2f, closure %.4f\n", s->schedule_num, s->best_cost, stats->n, stats->avg_deg, stats->nbr_deg, stats->closure);
+    fprintf(fp, "#define GENERATED_NAME \"%s\"\n", p->name);
+    fprintf(fp, "#define GENERATED_FUNC gen_%s\n", p->name);
+    fprintf(fp, "#define GENERATED_LOWER_SECOND %d  // the second level only takes neighbors below the root\n", plan->check_bound[1]);
+    fprintf(fp, "#define GENERATED_WORKLOAD(deg, eff_deg, avg_deg, n) (%s)  // analytic model of a root\n", workload);
+    fprintf(fp, "#define GENERATED_PLAN \"");
+    for (uint32_t i = 0; i < plan->size; i++) {
+        fprintf(fp, "%u ", plan->order[i]);
+    }
+    fprintf(fp, "%s\"  // order and model, part of the cache key\n", workload);
+    fprintf(fp, "\n#endif // GENERATED_H\n");
+    fclose(fp);
+}
+
+static void write_dpu(const char *dir, const char *spec, const Pattern *p, const Plan *plan) {
+    Emitter e = {open_output(dir, "dpu.c"), plan, true};
+    const char *name = p->name;
+    bool lower = plan->check_bound[1];
+    emit(&e, 0, "#include <dpu_mine.h>");
+    emit(&e, 0, "#include <stdbool.h>");
+    emit(&e, 0, "");
+    emit(&e, 0, "// %s kernel generated by bin/codegen from %s, generated.h describes the plan", name, spec);
+    emit(&e, 0, "");
+    emit_helpers(&e);
+
+    emit(&e, 0, "static ans_t __imp_gen_%s_2(sysname_t tasklet_id, node_t root, node_t second_root) {", name);
+    if (plan->uses_buffers) {
+        emit(&e, 1, "node_t(*tasklet_buf)[BUF_SIZE] = buf[tasklet_id];");
+        emit(&e, 0, "");
+    }
+    else {
+        emit(&e, 1, "(void)tasklet_id;");
+    }
+    if (plan->row_used[0]) emit_rows(&e, 1, 0);
+    if (plan->row_used[1]) emit_rows(&e, 1, 1);
+    emit(&e, 1, "ans_t ans = 0;");
+    emit_level(&e, 1, 2);
+    emit(&e, 1, "return ans;");
+    emit(&e, 0, "}");
+    emit(&e, 0, "");
+
+    emit(&e, 0, "static ans_t __imp_gen_%s(sysname_t tasklet_id, node_t root) {", name);
+    emit(&e, 1, "edge_ptr root_begin = row_ptr[root];  // intended DMA");
+    emit(&e, 1, "edge_ptr root_end = row_ptr[root + 1];  // intended DMA");
+    emit(&e, 1, "ans_t ans = 0;");
+    emit(&e, 1, "for (edge_ptr i = root_begin; i < root_end; i++) {");
+    emit(&e, 2, "node_t second_root = col_idx[i];  // intended DMA");
+    if (lower) emit(&e, 2, "if (second_root >= root) break;");
+    emit(&e, 2, "ans += __imp_gen_%s_2(tasklet_id, root, second_root);", name);
+    emit(&e, 1, "}");
+    emit(&e, 1, "return ans;");
+    emit(&e, 0, "}");
+    emit(&e, 0, "");
+
+    // heavy roots are shared by all tasklets at the second level, the rest go round robin
+    emit(&e, 0, "extern void gen_%s(sysname_t tasklet_id) {", name);
+    emit(&e, 1, "static ans_t partial_ans[NR_TASKLETS];");
+    emit(&e, 1, "static uint64_t partial_cycle[NR_TASKLETS];");
+    emit(&e, 1, "static perfcounter_cycles cycles[NR_TASKLETS];");
+    emit(&e, 0, "");
+    emit(&e, 1, "node_t i = 0;");
+    emit(&e, 1, "while (i < root_num) {");
+    emit(&e, 2, "node_t root = roots[i];  // intended DMA");
+    emit(&e, 2, "node_t root_begin = row_ptr[root];  // intended DMA");
+    emit(&e, 2, "node_t root_end = row_ptr[root + 1];  // intended DMA");
+    emit(&e, 2, "if (root_end - root_begin < BRANCH_LEVEL_THRESHOLD) {");
+    emit(&e, 3, "break;");
+    emit(&e, 2, "}");
+    emit(&e, 2, "node_t split_begin = root_begin, split_end = root_end;");
+    emit(&e, 0, "#ifdef SPLIT_ROOTS");
+    emit(&e, 2, "if (i < split_num) {");
+    emit(&e, 3, "split_begin = root_begin + split_range[i][0];  // intended DMA");
+    emit(&e, 3, "split_end = root_begin + split_range[i][1];  // intended DMA");
+    emit(&e, 2, "}");
+    emit(&e, 0, "#endif");
+    emit(&e, 0, "");
+    emit(&e, 2, "barrier_wait(&co_barrier);");
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 2, "timer_start(&cycles[tasklet_id]);");
+    emit(&e, 0, "#endif");
+    emit(&e, 2, "partial_ans[tasklet_id] = 0;");
+    emit(&e, 2, "for (edge_ptr j = split_begin + tasklet_id; j < split_end; j += NR_TASKLETS) {");
+    emit(&e, 3, "node_t second_root = col_idx[j];  // intended DMA");
+    if (lower) emit(&e, 3, "if (second_root >= root) break;");
+    emit(&e, 3, "partial_ans[tasklet_id] += __imp_gen_%s_2(tasklet_id, root, second_root);", name);
+    emit(&e, 2, "}");
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 2, "partial_cycle[tasklet_id] = timer_stop(&cycles[tasklet_id]);");
+    emit(&e, 0, "#endif");
+    emit(&e, 2, "barrier_wait(&co_barrier);");
+    emit(&e, 2, "if (tasklet_id == 0) {");
+    emit(&e, 3, "ans_t total_ans = 0;");
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 3, "uint64_t total_cycle = 0;");
+    emit(&e, 0, "#endif");
+    emit(&e, 3, "for (uint32_t j = 0; j < NR_TASKLETS; j++) {");
+    emit(&e, 4, "total_ans += partial_ans[j];");
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 4, "total_cycle += partial_cycle[j];");
+    emit(&e, 0, "#endif");
+    emit(&e, 3, "}");
+    emit(&e, 3, "STORE_ANS(tasklet_id, i, total_ans);");
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 3, "STORE_CYCLE(tasklet_id, i, total_cycle);");
+    emit(&e, 0, "#endif");
+    emit(&e, 2, "}");
+    emit(&e, 2, "i++;");
+    emit(&e, 1, "}");
+    emit(&e, 0, "");
+    emit(&e, 1, "for (i += tasklet_id; i < root_num; i += NR_TASKLETS) {");
+    emit(&e, 2, "node_t root = roots[i];  // intended DMA");
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 2, "timer_start(&cycles[tasklet_id]);");
+    emit(&e, 0, "#endif");
+    emit(&e, 2, "STORE_ANS(tasklet_id, i, __imp_gen_%s(tasklet_id, root));", name);
+    emit(&e, 0, "#ifdef PERF");
+    emit(&e, 2, "STORE_CYCLE(tasklet_id, i, timer_stop(&cycles[tasklet_id]));");
+    emit(&e, 0, "#endif");
+    emit(&e, 1, "}");
+    emit(&e, 0, "}");
+    fclose(e.fp);
+}
+
+static void write_host(const char *dir, const char *spec, const Pattern *p, const Plan *plan) {
+    Emitter e = {open_output(dir, "host.c"), plan, false};
+    emit(&e, 0, "#include <common.h>");
+    emit(&e, 0, "#include <stdbool.h>");
+    emit(&e, 0, "");
+    emit(&e, 0, "// %s host reference generated by bin/codegen from %s, generated.h describes the plan", p->name, spec);
+    emit(&e, 0, "");
+    emit(&e, 0, "extern node_t intersect(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c);");
+    emit(&e, 0, "extern node_t intersect_count(node_t *a, node_t a_size, node_t *b, node_t b_size);");
+    emit(&e, 0, "extern node_t intersect_below(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t bound, node_t *c);");
+    emit(&e, 0, "extern node_t intersect_count_below(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t bound);");
+    emit(&e, 0, "");
+    emit_helpers(&e);
+    emit(&e, 0, "ans_t gen_%s(Graph *g, node_t root, node_t **buf) {", p->name);
+    if (!plan->host_uses_buffers) emit(&e, 1, "(void)buf;");
+    emit_rows(&e, 1, 0);
+    emit(&e, 1, "ans_t ans = 0;");
+    emit(&e, 1, "for (edge_ptr i = root_begin; i < root_end; i++) {");
+    emit(&e, 2, "node_t second_root = g->col_idx[i];");
+    if (plan->check_bound[1]) emit(&e, 2, "if (second_root >= root) break;");
+    if (plan->row_used[1]) emit_rows(&e, 2, 1);
+    emit_level(&e, 2, 2);
+    emit(&e, 1, "}");
+    emit(&e, 1, "return ans;");
+    emit(&e, 0, "}");
+    fclose(e.fp);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-g graph.bin] [-v] <spec> <out_dir>\n", prog);
+    printf("  writes generated.h, dpu.c and host.c of the pattern in spec to out_dir\n");
+    printf("  -g    plan with the degree statistics of this graph instead of typical ones\n");
+    printf("  -v    print every schedule tried with its cost\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *graph = NULL;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "g:vh")) != -1) {
+        switch (opt) {
+        case 'g':
+            graph = optarg;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) usage(argv[0]);
+    const char *spec = argv[optind];
+    const char *out_dir = argv[optind + 1];
+
+    Pattern p;
+    read_spec(spec, &p);
+    GraphStats stats = {DEFAULT_N, DEFAULT_AVG_DEG, DEFAULT_NBR_DEG, DEFAULT_CLOSURE};
+    if (graph) read_graph_stats(graph, &stats);
+    static uint8_t autos[MAX_AUTOMORPHISMS][MAX_PATTERN_SIZE];
+    uint32_t auto_num = 0;
+    uint8_t perm[MAX_PATTERN_SIZE];
+    bool used[MAX_PATTERN_SIZE] = {false};
+    find_automorphisms(&p, perm, used, 0, autos, &auto_num);
+
+    static Search s;
+    s.p = &p;
+    s.autos = autos;
+    s.auto_num = auto_num;
+    s.stats = &stats;
+    s.verbose = verbose;
+    s.plan.size = p.size;
+    s.best_cost = INFINITY;
+    bool fits = false;
+    for (uint32_t u = 0; u < p.size; u++) {
+        fits |= root_fits(&p, u);
+    }
+    if (!fits) fail("%s has no vertex whose non-neighbors are independent, the dpu images cannot hold it", p.name);
+    bool placed[MAX_PATTERN_SIZE] = {false};
+    search_orders(&s, 0, placed);
+    if (!s.schedule_num) fail("%s needs more than %d buffers per tasklet", p.name, KERNEL_BUF_NUM);
+
+    write_header(out_dir, spec, &s);
+    write_dpu(out_dir, spec, &p, &s.best);
+    write_host(out_dir, spec, &p, &s.best);
+    printf("%s: %u automorphisms, %u schedules, order", p.name, auto_num, s.schedule_num);
+    for (uint32_t i = 0; i < p.size; i++) {
+        printf(" %u", s.best.order[i]);
+    }
+    printf(", cost %.4g\n", s.best_cost);
+    return 0;
+}
@@ -0,0 +1,370 @@
+#define _FILE_OFFSET_BITS 64
+#define _DEFAULT_SOURCE
+#include <common.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// Convert a SNAP text edge list (or binary uint32 edge pairs) into the .bin CSR layout read by the host:
+//   n, m, row_ptr[n], col_idx[m]
+// Edges are symmetrized, self loops dropped and duplicates removed. Sorting is an external merge sort,
+// so only the memory budget is held in RAM no matter how large the graph is.
+
+#define MAX_FANIN 64
+#define EDGE_RADIX_BITS 16
+#define EDGE_RADIX_SIZE (1 << EDGE_RADIX_BITS)
+
+typedef uint64_t edge_t;  // (src << 32) | dst, so sorting edges sorts by src then dst
+#define EDGE(u, v) (((edge_t)(u) << 32) | (v))
+#define EDGE_SRC(e) ((node_t)((e) >> 32))
+#define EDGE_DST(e) ((node_t)(e))
+
+typedef struct RunReader {
+    FILE *fp;
+    edge_t *buf;
+    size_t cap;
+    size_t pos;
+    size_t len;
+} RunReader;
+
+typedef struct HeapItem {
+    edge_t edge;
+    uint32_t run;
+} HeapItem;
+
+static const char *tmp_dir;
+static uint32_t run_count;
+static uint32_t run_id;
+static uint32_t *runs;   // ids of runs waiting to be merged
+static uint32_t runs_cap;
+static node_t max_node;
+static bool has_node;
+
+static void fail(const char *msg, const char *arg) {
+    fprintf(stderr, ANSI_COLOR_RED "Error: %s%s\n" ANSI_COLOR_RESET, msg, arg ? arg : "");
+    exit(1);
+}
+
+static void run_path(uint32_t id, char *path, size_t size) {
+    snprintf(path, size, "%s/convert.%d.%u.run", tmp_dir, (int)getpid(), id);
+}
+
+static void add_run(uint32_t id) {
+    if (run_count == runs_cap) {
+        runs_cap = runs_cap ? runs_cap << 1 : 64;
+        runs = realloc(runs, runs_cap * sizeof(uint32_t));
+    }
+    runs[run_count++] = id;
+}
+
+static void sort_edges(edge_t *edges, edge_t *tmp, size_t size) {
+    static size_t offset[EDGE_RADIX_SIZE];
+    edge_t *in = edges, *out = tmp;
+    for (uint32_t shift = 0; shift < 64; shift += EDGE_RADIX_BITS) {
+        memset(offset, 0, sizeof(offset));
+        for (size_t i = 0; i < size; i++) {
+            offset[(in[i] >> shift) & (EDGE_RADIX_SIZE - 1)]++;
+        }
+        if (offset[(in[0] >> shift) & (EDGE_RADIX_SIZE - 1)] == size) continue;   // digit is constant
+        size_t sum = 0;
+        for (uint32_t d = 0; d < EDGE_RADIX_SIZE; d++) {
+            size_t count = offset[d];
+            offset[d] = sum;
+            sum += count;
+        }
+        for (size_t i = 0; i < size; i++) {
+            out[offset[(in[i] >> shift) & (EDGE_RADIX_SIZE - 1)]++] = in[i];
+        }
+        edge_t *swap = in;
+        in = out;
+        out = swap;
+    }
+    if (in != edges) {
+        memcpy(edges, in, size * sizeof(edge_t));
+    }
+}
+
+// sort, deduplicate and spill one in-memory run
+static void flush_run(edge_t *edges, edge_t *tmp, size_t size) {
+    if (size == 0) return;
+    sort_edges(edges, tmp, size);
+    size_t unique = 1;
+    for (size_t i = 1; i < size; i++) {
+        if (edges[i] != edges[unique - 1]) edges[unique++] = edges[i];
+    }
+    char path[4096];
+    uint32_t id = run_id++;
+    run_path(id, path, sizeof(path));
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fwrite(edges, sizeof(edge_t), unique, fp) != unique || fclose(fp) != 0) {
+        fail("cannot write temporary run ", path);
+    }
+    add_run(id);
+    printf("Run %u: %zu edges\n", id, unique);
+}
+
+static inline void add_edge(edge_t *edges, edge_t *tmp, size_t cap, size_t *size, node_t u, node_t v) {
+    if (u == v) return;
+    if (u == INVALID_NODE || v == INVALID_NODE) fail("vertex id too large", NULL);
+    if (*size + 2 > cap) {
+        flush_run(edges, tmp, *size);
+        *size = 0;
+    }
+    edges[(*size)++] = EDGE(u, v);
+    edges[(*size)++] = EDGE(v, u);
+    node_t larger = MAX(u, v);
+    if (!has_node || larger > max_node) max_node = larger;
+    has_node = true;
+}
+
+static void read_text(FILE *fin, edge_t *edges, edge_t *tmp, size_t cap) {
+    size_t size = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), fin)) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '%' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+        char *end;
+        unsigned long long u = strtoull(p, &end, 10);
+        if (end == p) fail("malformed line: ", line);
+        p = end;
+        unsigned long long v = strtoull(p, &end, 10);
+        if (end == p) fail("malformed line: ", line);
+        if (u >= INVALID_NODE || v >= INVALID_NODE) fail("vertex id too large: ", line);
+        add_edge(edges, tmp, cap, &size, (node_t)u, (node_t)v);
+    }
+    flush_run(edges, tmp, size);
+}
+
+static void read_binary(FILE *fin, edge_t *edges, edge_t *tmp, size_t cap) {
+    size_t size = 0;
+    node_t pair[2 * 4096];
+    size_t count;
+    while ((count = fread(pair, sizeof(node_t) * 2, 4096, fin)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            add_edge(edges, tmp, cap, &size, pair[i << 1], pair[(i << 1) | 1]);
+        }
+    }
+    flush_run(edges, tmp, size);
+}
+
+static bool reader_next(RunReader *reader, edge_t *edge) {
+    if (reader->pos == reader->len) {
+        reader->len = fread(reader->buf, sizeof(edge_t), reader->cap, reader->fp);
+        reader->pos = 0;
+        if (reader->len == 0) return false;
+    }
+    *edge = reader->buf[reader->pos++];
+    return true;
+}
+
+static void heap_down(HeapItem *heap, uint32_t size, uint32_t i) {
+    while (1) {
+        uint32_t left = (i << 1) + 1;
+        uint32_t right = (i << 1) + 2;
+        uint32_t min_item = i;
+        if (left < size && heap[left].edge < heap[min_item].edge) min_item = left;
+        if (right < size && heap[right].edge < heap[min_item].edge) min_item = right;
+        if (min_item == i) break;
+        HeapItem tmp = heap[i];
+        heap[i] = heap[min_item];
+        heap[min_item] = tmp;
+        i = min_item;
+    }
+}
+
+typedef void (*emit_func_t)(edge_t edge, void *arg);
+
+// k-way merge of the given runs, emitting every distinct edge in order
+static void merge_runs(const uint32_t *ids, uint32_t count, size_t budget, emit_func_t emit, void *arg) {
+    RunReader readers[MAX_FANIN];
+    HeapItem heap[MAX_FANIN];
+    uint32_t heap_size = 0;
+    size_t cap = MAX(budget / sizeof(edge_t) / (count + 1), (size_t)1024);
+    for (uint32_t i = 0; i < count; i++) {
+        char path[4096];
+        run_path(ids[i], path, sizeof(path));
+        readers[i].fp = fopen(path, "rb");
+        if (!readers[i].fp) fail("cannot read temporary run ", path);
+        readers[i].buf = malloc(cap * sizeof(edge_t));
+        readers[i].cap = cap;
+        readers[i].pos = readers[i].len = 0;
+        if (reader_next(&readers[i], &heap[heap_size].edge)) {
+            heap[heap_size++].run = i;
+        }
+    }
+    for (uint32_t i = heap_size; i-- > 0;) {
+        heap_down(heap, heap_size, i);
+    }
+    bool first_edge = true;
+    edge_t last = 0;
+    while (heap_size) {
+        edge_t edge = heap[0].edge;
+        if (first_edge || edge != last) {
+            emit(edge, arg);
+            last = edge;
+            first_edge = false;
+        }
+        if (!reader_next(&readers[heap[0].run], &heap[0].edge)) {
+            heap[0] = heap[--heap_size];
+        }
+        heap_down(heap, heap_size, 0);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        char path[4096];
+        run_path(ids[i], path, sizeof(path));
+        fclose(readers[i].fp);
+        free(readers[i].buf);
+        remove(path);
+    }
+}
+
+typedef struct RunWriter {
+    FILE *fp;
+    edge_t *buf;
+    size_t cap;
+    size_t len;
+} RunWriter;
+
+static void emit_run(edge_t edge, void *arg) {
+    RunWriter *writer = arg;
+    if (writer->len == writer->cap) {
+        if (fwrite(writer->buf, sizeof(edge_t), writer->len, writer->fp) != writer->len) fail("cannot write temporary run", NULL);
+        writer->len = 0;
+    }
+    writer->buf[writer->len++] = edge;
+}
+
+// merge groups of MAX_FANIN runs until a single final merge is possible
+static void reduce_runs(size_t budget) {
+    while (run_count > MAX_FANIN) {
+        uint32_t old_count = run_count;
+        uint32_t *old_runs = runs;
+        runs = NULL;
+        run_count = runs_cap = 0;
+        for (uint32_t first = 0; first < old_count; first += MAX_FANIN) {
+            uint32_t count = MIN(MAX_FANIN, old_count - first);
+            char path[4096];
+            uint32_t id = run_id++;
+            run_path(id, path, sizeof(path));
+            RunWriter writer;
+            writer.fp = fopen(path, "wb");
+            if (!writer.fp) fail("cannot write temporary run ", path);
+            writer.cap = MAX(budget / sizeof(edge_t) / (count + 2), (size_t)1024);
+            writer.buf = malloc(writer.cap * sizeof(edge_t));
+            writer.len = 0;
+            merge_runs(old_runs + first, count, budget - writer.cap * sizeof(edge_t), emit_run, &writer);
+            if (fwrite(writer.buf, sizeof(edge_t), writer.len, writer.fp) != writer.len || fclose(writer.fp) != 0) fail("cannot write temporary run ", path);
+            free(writer.buf);
+            add_run(id);
+        }
+        free(old_runs);
+        printf("Merged %u runs into %u\n", old_count, run_count);
+    }
+}
+
+typedef struct CsrWriter {
+    FILE *row_fp;   // positioned at row_ptr
+    FILE *col_fp;   // positioned at col_idx
+    node_t n;
+    node_t next_row;   // first vertex whose row_ptr is not written yet
+    uint64_t m;
+} CsrWriter;
+
+static void write_row_ptr(CsrWriter *writer, node_t end) {
+    edge_ptr cur = (edge_ptr)writer->m;
+    for (; writer->next_row < end; writer->next_row++) {
+        if (fwrite(&cur, sizeof(edge_ptr), 1, writer->row_fp) != 1) fail("cannot write row_ptr", NULL);
+    }
+}
+
+static void emit_csr(edge_t edge, void *arg) {
+    CsrWriter *writer = arg;
+    node_t u = EDGE_SRC(edge);
+    node_t v = EDGE_DST(edge);
+    write_row_ptr(writer, u + 1);
+    if (writer->m >= (uint64_t)(edge_ptr)(-1)) fail("too many edges for edge_ptr", NULL);
+    if (fwrite(&v, sizeof(node_t), 1, writer->col_fp) != 1) fail("cannot write col_idx", NULL);
+    writer->m++;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-b] [-M budget_mb] [-T tmp_dir] <input> <output.bin>\n", prog);
+    printf("  -b    input holds binary uint32_t edge pairs instead of a SNAP text edge list\n");
+    printf("  -M    memory budget for sorting in MB (default 1024)\n");
+    printf("  -T    directory for temporary runs (default: directory of the output)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    bool binary = false;
+    size_t budget = (size_t)1024 << 20;
+    const char *tmp_arg = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "bM:T:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            binary = true;
+            break;
+        case 'M':
+            budget = (size_t)strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'T':
+            tmp_arg = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || budget < ((size_t)1 << 20)) usage(argv[0]);
+    const char *input = argv[optind];
+    const char *output = argv[optind + 1];
+
+    char out_dir[4096];
+    if (!tmp_arg) {
+        snprintf(out_dir, sizeof(out_dir), "%s", output);
+        char *slash = strrchr(out_dir, '/');
+        if (slash) *slash = '\0';
+        else snprintf(out_dir, sizeof(out_dir), ".");
+        tmp_arg = out_dir;
+    }
+    tmp_dir = tmp_arg;
+
+    // phase 1: sorted, deduplicated runs of at most budget bytes (edges plus radix scratch)
+    FILE *fin = fopen(input, binary ? "rb" : "r");
+    if (!fin) fail("cannot open ", input);
+    size_t cap = budget / sizeof(edge_t) / 2;
+    edge_t *edges = malloc(cap * sizeof(edge_t));
+    edge_t *tmp = malloc(cap * sizeof(edge_t));
+    if (!edges || !tmp) fail("cannot allocate the memory budget", NULL);
+    if (binary) read_binary(fin, edges, tmp, cap);
+    else read_text(fin, edges, tmp, cap);
+    fclose(fin);
+    free(edges);
+    free(tmp);
+
+    // phase 2: merge into n, m, row_ptr[n], col_idx[m]
+    reduce_runs(budget);
+    CsrWriter writer;
+    writer.n = has_node ? max_node + 1 : 0;
+    writer.next_row = 0;
+    writer.m = 0;
+    writer.row_fp = fopen(output, "wb");
+    if (!writer.row_fp) fail("cannot open ", output);
+    uint32_t header[2] = {writer.n, 0};
+    if (fwrite(header, sizeof(header), 1, writer.row_fp) != 1) fail("cannot write ", output);
+    fflush(writer.row_fp);
+    writer.col_fp = fopen(output, "r+b");
+    if (!writer.col_fp || fseeko(writer.col_fp, (off_t)sizeof(header) + (off_t)writer.n * sizeof(edge_ptr), SEEK_SET) != 0) fail("cannot open ", output);
+    if (run_count) merge_runs(runs, run_count, budget, emit_csr, &writer);
+    write_row_ptr(&writer, writer.n);
+    if (fclose(writer.col_fp) != 0) fail("cannot write ", output);
+    header[1] = (edge_ptr)writer.m;
+    if (fseeko(writer.row_fp, 0, SEEK_SET) != 0 || fwrite(header, sizeof(header), 1, writer.row_fp) != 1 || fclose(writer.row_fp) != 0) fail("cannot write ", output);
+    free(runs);
+
+    printf("N: %u, M: %lu, avg_deg: %f\n", writer.n, writer.m, writer.n ? (double)writer.m / writer.n : 0.0);
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <common.h>
+#include <stdlib.h>
 
 typedef struct ElementType {
     uint32_t dpu_id;
@@ -6,14 +7,16 @@ typedef struct ElementType {
 } ElementType;
 
 uint32_t queue_size;
-ElementType Elements[NR_DPUS];
+ElementType *Elements;  // one entry per root list
 
-void queue_init() {
-    for (uint32_t i = 0; i < NR_DPUS; i++) {
+void queue_init(uint32_t size) {
+    free(Elements);
+    Elements = malloc(size * sizeof(ElementType));
+    for (uint32_t i = 0; i < size; i++) {
         Elements[i].dpu_id = i;
         Elements[i].workload = 0;
     }
-    queue_size = NR_DPUS;
+    queue_size = size;
 }
 
 void push_to_queue(uint32_t dpu_id, double workload) {
@@ -52,4 +55,8 @@ uint32_t pop_from_queue() {
         i = min_element;
     }
     return ans;
-}
\ No newline at end of file
+}
+
+uint32_t top_of_queue() {
+    return Elements[0].dpu_id;
+}
@@ -1,138 +1,562 @@
+#define _DEFAULT_SOURCE
 #include <common.h>
 #include <timer.h>
+#include <parallel.h>
+#include <server.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <dpu.h>
 
-extern void data_transfer(struct dpu_set_t set, Graph *g);
-extern ans_t clique2(Graph *g, node_t root);
-extern ans_t KERNEL_FUNC(Graph *g, node_t root);
+extern void data_transfer(struct dpu_set_t set, Graph *g, const char *path);
+extern ans_t clique2(Graph *g, node_t root, node_t **buf);
+extern ans_t cpu_mine(Graph *g, uint32_t pattern, const node_t *roots, uint64_t root_num, ans_t *result);
+extern const char *const pattern_names[NR_PATTERNS];
+extern uint32_t pattern_set;
+#ifdef DYNAMIC_SCHEDULE
+extern bool data_schedule(struct dpu_set_t set, Graph *g, ans_t *result, uint64_t *cycle_ct, uint32_t *executed_on);
+#endif
+#ifdef MULTI_PASS
+extern void epoch_push(struct dpu_set_t set, uint32_t epoch);
+extern void epoch_free();
+#endif
 Graph *g;
-ans_t ans[N];
-ans_t result[N];
+ans_t *ans;
+ans_t *result;
 Timer timer;
-uint64_t cycle_ct[N];
-uint64_t cycle_ct_dpu[NR_DPUS][NR_TASKLETS];
+uint64_t *cycle_ct;
+uint64_t (*cycle_ct_dpu)[NR_TASKLETS];  // nr_dpus rows
+struct dpu_set_t set;
+uint32_t nr_dpus;
+char data_name[256];
+#ifndef DYNAMIC_SCHEDULE
+uint64_t gather_stride;  // uint64_t per part in gather_buf, enough for the longest root list, 1 with TOTAL_ONLY
+uint64_t *gather_buf;  // answers of all parts side by side, followed by their cycle counts with PERF
+#endif
+#ifdef MULTI_PASS
+uint32_t *rank_first;  // first dpu of every rank
+uint32_t resident_epoch;  // epoch whose root lists and images are in mram
+bool epoch_failed;
+#endif
 
-int main() {
-    printf("NR_DPUS: %u, NR_TASKLETS: %u, DPU_BINARY: %s, PATTERN: %s\n", NR_DPUS, NR_TASKLETS, DPU_BINARY, PATTERN_NAME);
+// "./data/Wiki-Vote.bin" -> "Wiki-Vote"
+static void get_data_name(const char *path, char *name, size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    const char *ext = strrchr(base, '.');
+    size_t len = ext ? (size_t)(ext - base) : strlen(base);
+    if (len >= size) len = size - 1;
+    memcpy(name, base, len);
+    name[len] = '\0';
+}
 
-    struct dpu_set_t set, dpu;
-    // DPU_ASSERT(dpu_alloc(NR_DPUS, NULL, &set));
-    DPU_ASSERT(dpu_alloc(NR_DPUS, "backend=simulator", &set));
+#if defined(PERF) && !defined(TOTAL_ONLY)
+// roots with at least BRANCH_LEVEL_THRESHOLD neighbors are split over all tasklets, the rest go round robin
+static void account_cycle(uint32_t dpu_id, node_t root, uint64_t cycle, uint32_t *cur_thread) {
+    if (g->row_ptr[root + 1] - g->row_ptr[root] >= BRANCH_LEVEL_THRESHOLD) {
+        for (uint32_t i = 0; i < NR_TASKLETS; i++) {
+            cycle_ct_dpu[dpu_id][i] += cycle / NR_TASKLETS;
+        }
+    }
+    else {
+        cycle_ct_dpu[dpu_id][*cur_thread] += cycle;
+        *cur_thread = (*cur_thread + 1) % NR_TASKLETS;
+    }
+}
+#endif
 
-    // task allocation and data partition
-    printf("Selecting graph: %s\n", DATA_PATH);
-    start(&timer, 0, 0);
-    g = malloc(sizeof(Graph));
-    data_transfer(set, g);
-    stop(&timer, 0);
-    printf("Data transfer ");
-    print(&timer, 0, 1);
+#ifndef DYNAMIC_SCHEDULE
+#ifdef TOTAL_ONLY
+#define ANS_SYMBOL "ans_sum"
+#define CYCLE_SYMBOL "cycle_sum"
+#else
+#define ANS_SYMBOL "ans"
+#define CYCLE_SYMBOL "cycle_ct"
+#endif
 
-    // run it on CPU to get the answer
+// answers of the dpus in dpus, and their cycle counts with PERF, into gather_buf from part first on
+static void gather_xfer(struct dpu_set_t dpus, uint32_t first) {
+    struct dpu_set_t dpu;
+    uint32_t each_dpu;
+    DPU_FOREACH(dpus, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &gather_buf[(first + each_dpu) * gather_stride]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpus, DPU_XFER_FROM_DPU, ANS_SYMBOL, 0, gather_stride * sizeof(uint64_t), DPU_XFER_DEFAULT));
+#ifdef PERF
+    DPU_FOREACH(dpus, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &gather_buf[(g->part_num + first + each_dpu) * gather_stride]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpus, DPU_XFER_FROM_DPU, CYCLE_SYMBOL, 0, gather_stride * sizeof(uint64_t), DPU_XFER_DEFAULT));
+#endif
+}
+#endif
+
+#ifdef MULTI_PASS
+// runs on a rank right after its launch of one epoch, before the rank takes the next one
+static dpu_error_t epoch_gather(struct dpu_set_t rank, uint32_t rank_id, void *arg) {
+    uint32_t epoch = (uint32_t)(uintptr_t)arg;
+    bool finished, failed;
+    DPU_ASSERT(dpu_status(rank, &finished, &failed));
+    if (failed) {
+        printf("Rank: %u failed in epoch %u\n", rank_id, epoch);
+        __atomic_store_n(&epoch_failed, true, __ATOMIC_RELAXED);
+        return DPU_OK;
+    }
+    gather_xfer(rank, epoch * nr_dpus + rank_first[rank_id]);
+    return DPU_OK;
+}
+#endif
+
+#if !defined(DYNAMIC_SCHEDULE) && !defined(TOTAL_ONLY)
+typedef struct GatherArgs {
+    ans_t total_ans[MAX_HOST_THREADS];
+    uint64_t total_cycle[MAX_HOST_THREADS];
+    uint32_t wrong_dpu[MAX_HOST_THREADS];  // nr_dpus if every answer matched
+} GatherArgs;
+
+// a root that is not split has exactly one part, so every thread owns the results of its slice of
+// dpus, with the parts of all epochs that ran on them
+static void gather_dpus(uint32_t tid, uint32_t nr_threads, void *arg) {
+    GatherArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(nr_dpus, tid, nr_threads, &begin, &end);
     ans_t total_ans = 0;
+    uint64_t total_cycle = 0;
+    uint32_t wrong_dpu = nr_dpus;
+    for (uint32_t d = begin; d < end; d++) {
+#ifdef PERF
+        uint32_t cur_thread = 0;
+#endif
+        for (uint32_t i = d; i < g->part_num; i += nr_dpus) {
+            uint64_t *dpu_ans = &gather_buf[i * gather_stride];
+#ifdef PERF
+            uint64_t *dpu_cycle_ct = &gather_buf[(g->part_num + i) * gather_stride];
+#endif
+            for (uint64_t k = g->split_num[i]; k < g->root_num[i]; k++) {
+                node_t cur_root = g->roots[i][k];
+                result[cur_root] = dpu_ans[k];
+                total_ans += dpu_ans[k];
 #ifdef CPU_RUN
-    start(&timer, 0, 0);
-    for (node_t i = 0; i < g->n; i++) {
-        ans[i] = KERNEL_FUNC(g, i);
-        total_ans += ans[i];
+                if (ans[cur_root] != dpu_ans[k]) {
+                    printf("Wrong answer at dpu %u node %u: %lu != %lu\n", d, cur_root, ans[cur_root], dpu_ans[k]);
+                    if (wrong_dpu == nr_dpus) wrong_dpu = d;
+                }
+#endif
+#ifdef PERF
+                cycle_ct[cur_root] = dpu_cycle_ct[k];
+                account_cycle(d, cur_root, dpu_cycle_ct[k], &cur_thread);
+                total_cycle += dpu_cycle_ct[k];
+#endif
+            }
+        }
+    }
+    args->total_ans[tid] = total_ans;
+    args->total_cycle[tid] = total_cycle;
+    args->wrong_dpu[tid] = wrong_dpu;
+}
+#endif
+
+#ifdef HYBRID_CPU
+typedef struct HybridArgs {
+    uint32_t pattern;
+    ans_t total;
+    Timer timer;
+} HybridArgs;
+
+// the host share of the roots, run while the dpus work on theirs
+static void *hybrid_run(void *arg) {
+    HybridArgs *args = arg;
+    start(&args->timer, 0, 0);
+    args->total = cpu_mine(g, args->pattern, g->cpu_roots, g->cpu_root_num, result);
+    stop(&args->timer, 0);
+    return NULL;
+}
+#endif
+
+#ifdef ALL_PATTERNS
+// "clique3,cycle4" -> pattern ids in the given order, returns how many
+static uint32_t parse_patterns(const char *list, uint32_t *patterns) {
+    uint32_t num = 0;
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        uint32_t pattern = 0;
+        while (pattern < NR_PATTERNS && (strlen(pattern_names[pattern]) != len || strncmp(pattern_names[pattern], list, len))) pattern++;
+        if (pattern == NR_PATTERNS) {
+            printf(ANSI_COLOR_RED "Error: unknown pattern %.*s\n" ANSI_COLOR_RESET, (int)len, list);
+            exit(1);
+        }
+        if (!(BUILT_PATTERNS >> pattern & 1)) {
+            printf(ANSI_COLOR_RED "Error: pattern %.*s is not built into this binary\n" ANSI_COLOR_RESET, (int)len, list);
+            exit(1);
+        }
+        if (!(pattern_set >> pattern & 1)) {
+            pattern_set |= 1u << pattern;
+            patterns[num++] = pattern;
+        }
+        list += len;
+        if (*list == ',') list++;
+    }
+    if (num == 0) {
+        printf(ANSI_COLOR_RED "Error: no pattern selected\n" ANSI_COLOR_RESET);
+        exit(1);
     }
+    return num;
+}
+#endif
+
+// count one pattern on the graph resident in mram, false if a dpu failed or an answer is wrong
+static bool run_pattern(uint32_t pattern, ans_t *total) {
+    printf("Pattern: %s\n", pattern_names[pattern]);
+    memset(result, 0, (size_t)g->n * sizeof(ans_t));
+    memset(cycle_ct, 0, (size_t)g->n * sizeof(uint64_t));
+#ifdef PERF
+    memset(cycle_ct_dpu, 0, nr_dpus * sizeof(*cycle_ct_dpu));
+#endif
+#ifdef ALL_PATTERNS
+    uint64_t pattern_id = pattern;
+    DPU_ASSERT(dpu_broadcast_to(set, "pattern_id", 0, &pattern_id, sizeof(uint64_t), DPU_XFER_DEFAULT));
+#endif
+
+    // run it on CPU to get the answer
+#ifdef CPU_RUN
+    start(&timer, 0, 0);
+    ans_t cpu_total = cpu_mine(g, pattern, NULL, g->n, ans);
     stop(&timer, 0);
     printf("CPU ");
     print(&timer, 0, 1);
-    printf("CPU ans: %lu\n", total_ans);
+    printf("CPU ans: %lu\n", cpu_total);
 #endif  // CPU_RUN
 
     // run it on DPU
+    bool fine = true;
+#ifdef HYBRID_CPU
+    static HybridArgs hybrid;
+    hybrid.pattern = pattern;
+#endif
     start(&timer, 0, 0);
+#ifdef DYNAMIC_SCHEDULE
+    uint32_t *executed_on = malloc((size_t)g->n * sizeof(uint32_t));
+#ifdef HYBRID_CPU
+    // the scheduler keeps this thread, the host share gets its own
+    for (uint64_t k = 0; k < g->cpu_root_num; k++) {
+        executed_on[g->cpu_roots[k]] = nr_dpus;
+    }
+    pthread_t hybrid_thread;
+    if (pthread_create(&hybrid_thread, NULL, hybrid_run, &hybrid) != 0) {
+        printf(ANSI_COLOR_RED "Error: cannot create host thread\n" ANSI_COLOR_RESET);
+        exit(1);
+    }
+    fine = data_schedule(set, g, result, cycle_ct, executed_on);
+    pthread_join(hybrid_thread, NULL);
+#else
+    fine = data_schedule(set, g, result, cycle_ct, executed_on);
+#endif
+#elif defined(MULTI_PASS)
+    // every rank runs the epochs back to back from the resident one, taking the next epoch as
+    // soon as its own answers are read, while slower ranks are still busy
+    epoch_failed = false;
+    for (uint32_t k = 0; k < g->epoch_num; k++) {
+        uint32_t epoch = (resident_epoch + k) % g->epoch_num;
+        if (k) epoch_push(set, epoch);
+        DPU_ASSERT(dpu_launch(set, DPU_ASYNCHRONOUS));
+        DPU_ASSERT(dpu_callback(set, epoch_gather, (void *)(uintptr_t)epoch, DPU_CALLBACK_ASYNC));
+    }
+    resident_epoch = (resident_epoch + g->epoch_num - 1) % g->epoch_num;
+#ifdef HYBRID_CPU
+    hybrid_run(&hybrid);
+#endif
+    DPU_ASSERT(dpu_sync(set));
+#elif defined(HYBRID_CPU)
+    DPU_ASSERT(dpu_launch(set, DPU_ASYNCHRONOUS));
+    hybrid_run(&hybrid);
+    DPU_ASSERT(dpu_sync(set));
+#else
     DPU_ASSERT(dpu_launch(set, DPU_SYNCHRONOUS));
+#endif
     stop(&timer, 0);
     printf("DPU ");
     print(&timer, 0, 1);
+#ifdef HYBRID_CPU
+    printf("Host share ");
+    print(&hybrid.timer, 0, 1);
+#endif
 
     // collect answer and cycle count
-    bool fine = true;
-    bool finished, failed;
-    uint32_t each_dpu;
-    total_ans = 0;
+    ans_t total_ans = 0;
 #ifdef PERF
     uint64_t total_cycle_ct = 0;
 #endif
-    DPU_FOREACH(set, dpu, each_dpu) {
-        // check status
-        DPU_ASSERT(dpu_status(dpu, &finished, &failed));
-        if (failed) {
-            printf("DPU: %u failed\n", each_dpu);
+#ifdef DYNAMIC_SCHEDULE
+    uint32_t *cur_thread = calloc(nr_dpus, sizeof(uint32_t));
+    for (node_t i = 0; fine && i < g->n; i++) {
+        total_ans += result[i];
+#ifdef CPU_RUN
+        if (ans[i] != result[i]) {
+            printf("Wrong answer at dpu %u node %u: %lu != %lu\n", executed_on[i], i, ans[i], result[i]);
             fine = false;
-            break;
         }
+#endif  // CPU_RUN
+#ifdef PERF
+        if (executed_on[i] < nr_dpus) account_cycle(executed_on[i], i, cycle_ct[i], &cur_thread[executed_on[i]]);
+        total_cycle_ct += cycle_ct[i];
+#endif
+    }
+    free(executed_on);
+    free(cur_thread);
+#else
+#ifdef MULTI_PASS
+    // the epochs were gathered rank by rank as they finished
+    if (epoch_failed) {
+        *total = 0;
+        return false;
+    }
+#else
+    // check status, only look for the culprit if the set failed
+    struct dpu_set_t dpu;
+    bool finished, failed;
+    uint32_t each_dpu;
+    DPU_ASSERT(dpu_status(set, &finished, &failed));
+    if (failed) {
+        DPU_FOREACH(set, dpu, each_dpu) {
+            DPU_ASSERT(dpu_status(dpu, &finished, &failed));
+            if (failed) printf("DPU: %u failed\n", each_dpu);
+        }
+        *total = 0;
+        return false;
+    }
+    // one transfer per symbol for all dpus, then the host threads go through the slices
+    gather_xfer(set, 0);
+#endif
+#ifdef HYBRID_CPU
+    total_ans = hybrid.total;
+#endif
 
-        // collect answer
-        uint64_t *dpu_ans = (uint64_t *)malloc(ALIGN8(g->root_num[each_dpu] * sizeof(uint64_t)));
-        DPU_ASSERT(dpu_copy_from(dpu, "ans", 0, dpu_ans, ALIGN8(g->root_num[each_dpu] * sizeof(uint64_t))));
-        for (node_t k = 0; k < g->root_num[each_dpu]; k++) {
-            node_t cur_root = g->roots[each_dpu][k];
-            result[cur_root] = dpu_ans[k];
-            total_ans += dpu_ans[k];
+#ifdef TOTAL_ONLY
+    for (uint32_t i = 0; i < g->part_num; i++) {
+        total_ans += gather_buf[i];
+#ifdef PERF
+        total_cycle_ct += gather_buf[g->part_num + i];
+#endif
+    }
 #ifdef CPU_RUN
-            if (ans[cur_root] != dpu_ans[k]) {
-                printf("Wrong answer at dpu %u node %u: %lu != %lu\n", each_dpu, cur_root, ans[cur_root], dpu_ans[k]);
-#ifdef DPU_LOG
-                DPU_ASSERT(dpu_log_read(dpu, stdout));
+    if (cpu_total != total_ans) {
+        printf("Wrong answer: %lu != %lu\n", cpu_total, total_ans);
+        fine = false;
+    }
+#endif  // CPU_RUN
+#else
+    static GatherArgs args;
+    parallel_run(gather_dpus, &args);
+    for (uint32_t i = 0; i < host_thread_num(); i++) {
+        total_ans += args.total_ans[i];
+#ifdef PERF
+        total_cycle_ct += args.total_cycle[i];
 #endif
-                fine = false;
+#ifdef CPU_RUN
+        if (args.wrong_dpu[i] < nr_dpus) {
+            fine = false;
+#ifdef DPU_LOG
+            struct dpu_set_t dpu;
+            uint32_t each_dpu;
+            DPU_FOREACH(set, dpu, each_dpu) {
+                if (each_dpu == args.wrong_dpu[i]) DPU_ASSERT(dpu_log_read(dpu, stdout));
             }
-#endif  // CPU_RUN
+#endif
         }
-        free(dpu_ans);
+#endif  // CPU_RUN
+    }
 
-        // collect cycle count
+    // several parts add to a split root, so these are merged by one thread
+    for (uint32_t i = 0; i < g->part_num; i++) {
 #ifdef PERF
-        uint64_t *dpu_cycle_ct = (uint64_t *)malloc(ALIGN8(g->root_num[each_dpu] * sizeof(uint64_t)));
-        DPU_ASSERT(dpu_copy_from(dpu, "cycle_ct", 0, dpu_cycle_ct, ALIGN8(g->root_num[each_dpu] * sizeof(uint64_t))));
-        for (node_t k = 0, cur_thread = 0; k < g->root_num[each_dpu]; k++) {
-            node_t cur_root = g->roots[each_dpu][k];
-            cycle_ct[cur_root] = dpu_cycle_ct[k];
-            if (g->row_ptr[cur_root + 1] - g->row_ptr[cur_root] >= BRANCH_LEVEL_THRESHOLD) {
-                for (uint32_t i = 0; i < NR_TASKLETS; i++) {
-                    cycle_ct_dpu[each_dpu][i] += dpu_cycle_ct[k] / NR_TASKLETS;
-                }
-                total_cycle_ct += dpu_cycle_ct[k];
-            }
-            else {
-                cycle_ct_dpu[each_dpu][cur_thread] += dpu_cycle_ct[k];
-                cur_thread = (cur_thread + 1) % NR_TASKLETS;
-                total_cycle_ct += dpu_cycle_ct[k];
+        uint32_t cur_thread = 0;  // split roots are heavy, they never go round robin
+#endif
+        for (uint64_t k = 0; k < g->split_num[i]; k++) {
+            node_t cur_root = g->roots[i][k];
+            result[cur_root] += gather_buf[i * gather_stride + k];
+            total_ans += gather_buf[i * gather_stride + k];
+#ifdef PERF
+            uint64_t cycle = gather_buf[(g->part_num + i) * gather_stride + k];
+            cycle_ct[cur_root] += cycle;
+            account_cycle(i % nr_dpus, cur_root, cycle, &cur_thread);
+            total_cycle_ct += cycle;
+#endif
+        }
+    }
+#if defined(SPLIT_ROOTS) && defined(CPU_RUN)
+    for (uint32_t i = 0; fine && i < g->part_num; i++) {
+        for (uint64_t k = 0; k < g->split_num[i]; k++) {
+            node_t cur_root = g->roots[i][k];
+            if (ans[cur_root] != result[cur_root]) {
+                printf("Wrong answer at split node %u: %lu != %lu\n", cur_root, ans[cur_root], result[cur_root]);
+                fine = false;
+                break;
             }
         }
-        free(dpu_cycle_ct);
-#endif
     }
+#endif
+#endif  // TOTAL_ONLY
+#endif  // DYNAMIC_SCHEDULE
     printf("DPU ans: %lu\n", total_ans);
 #ifdef PERF
-    printf("Lower bound: %f\n", (double)total_cycle_ct / NR_DPUS / NR_TASKLETS / 350000);
+    printf("Lower bound: %f\n", (double)total_cycle_ct / nr_dpus / NR_TASKLETS / 350000);
 #endif
 
     // output result to file
-#ifdef PERF
-    FILE *fp = fopen("./result/" PATTERN_NAME "_" DATA_NAME ".txt", "w");
-    fprintf(fp, "NR_DPUS: %u, NR_TASKLETS: %u, DPU_BINARY: %s, PATTERN: %s\n", NR_DPUS, NR_TASKLETS, DPU_BINARY, PATTERN_NAME);
+#if defined(PERF) && !defined(TOTAL_ONLY)
+    char result_path[512];
+    snprintf(result_path, sizeof(result_path), RESULT_DIR "%s_%s.txt", pattern_names[pattern], data_name);
+    FILE *fp = fopen(result_path, "w");
+    fprintf(fp, "NR_DPUS: %u, NR_TASKLETS: %u, DPU_BINARY: %s, PATTERN: %s\n", nr_dpus, NR_TASKLETS, DPU_BINARY, pattern_names[pattern]);
     fprintf(fp, "N: %u, M: %u, avg_deg: %f\n", g->n, g->m, (double)g->m / g->n);
     for (node_t i = 0; i < g->n; i++) {
-        fprintf(fp, "node: %u, deg: %u, o_deg: %lu, ans: %lu, cycle: %lu,\n", i, g->row_ptr[i + 1] - g->row_ptr[i], clique2(g, i), result[i], cycle_ct[i]);
+        fprintf(fp, "node: %u, deg: %u, o_deg: %lu, ans: %lu, cycle: %lu,\n", i, g->row_ptr[i + 1] - g->row_ptr[i], clique2(g, i, NULL), result[i], cycle_ct[i]);
     }
-    for (uint32_t i = 0; i < NR_DPUS; i++) {
+    for (uint32_t i = 0; i < nr_dpus; i++) {
+        uint64_t root_num = 0;
+        for (uint32_t part = i; part < g->part_num; part += nr_dpus) root_num += g->root_num[part];
         for (uint32_t j = 0; j < NR_TASKLETS; j++) {
-            fprintf(fp, "DPU: %u, tasklet: %u, cycle: %lu, root_num: %lu\n", i, j, cycle_ct_dpu[i][j], g->root_num[i]);
+            fprintf(fp, "DPU: %u, tasklet: %u, cycle: %lu, root_num: %lu\n", i, j, cycle_ct_dpu[i][j], root_num);
         }
     }
     fclose(fp);
 #endif
+    *total = total_ans;
+    return fine;
+}
+
+static void usage(const char *name) {
+    printf("usage: %s [-s socket] [-d dpus] [-p profile] [graph.bin] [patterns]\n", name);
+    printf("  -s    keep the graph resident and answer queries on a unix socket\n");
+    printf("  -d    number of dpus, 0 for all available ranks (default %u)\n", NR_DPUS);
+    printf("  -p    dpu_alloc profile, \"\" for the hardware (default \"%s\")\n", DPU_PROFILE);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *socket_path = NULL;
+    const char *profile = DPU_PROFILE;
+    uint32_t dpu_num = NR_DPUS;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:p:h")) != -1) {
+        switch (opt) {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'd': {
+            char *end;
+            unsigned long num = strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || num > UINT32_MAX) {
+                printf(ANSI_COLOR_RED "Error: invalid dpu count %s\n" ANSI_COLOR_RESET, optarg);
+                exit(1);
+            }
+            dpu_num = num ? (uint32_t)num : DPU_ALLOCATE_ALL;
+            break;
+        }
+        case 'p':
+            profile = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    const char *data_path = argc > 0 ? argv[0] : DEFAULT_DATA_PATH;
+    get_data_name(data_path, data_name, sizeof(data_name));
+    uint32_t patterns[NR_PATTERNS];
+#ifdef ALL_PATTERNS
+    // several patterns share one graph transfer
+    const char *pattern_list = argc > 1 ? argv[1] : DEFAULT_PATTERNS;
+    uint32_t pattern_num = parse_patterns(pattern_list, patterns);
+#else
+    const char *pattern_list = PATTERN_NAME;
+    uint32_t pattern_num = 1;
+    patterns[0] = PATTERN_ID;
+#endif
+
+    // every per-dpu structure of the host is sized by the set that was actually allocated
+    DPU_ASSERT(dpu_alloc(dpu_num, profile, &set));
+    DPU_ASSERT(dpu_get_nr_dpus(set, &nr_dpus));
+    printf("NR_DPUS: %u, NR_TASKLETS: %u, DPU_BINARY: %s, PATTERN: %s\n", nr_dpus, NR_TASKLETS, DPU_BINARY, pattern_list);
+    cycle_ct_dpu = malloc(nr_dpus * sizeof(*cycle_ct_dpu));
+#ifdef MULTI_PASS
+    struct dpu_set_t rank;
+    uint32_t nr_ranks, each_rank, rank_dpus, dpu_offset = 0;
+    DPU_ASSERT(dpu_get_nr_ranks(set, &nr_ranks));
+    rank_first = malloc(nr_ranks * sizeof(uint32_t));
+    DPU_RANK_FOREACH(set, rank, each_rank) {
+        DPU_ASSERT(dpu_get_nr_dpus(rank, &rank_dpus));
+        rank_first[each_rank] = dpu_offset;
+        dpu_offset += rank_dpus;
+    }
+#endif
+
+    // task allocation and data partition
+    printf("Selecting graph: %s\n", data_path);
+    start(&timer, 0, 0);
+    g = malloc(sizeof(Graph));
+    data_transfer(set, g, data_path);
+    stop(&timer, 0);
+    printf("Data transfer ");
+    print(&timer, 0, 1);
+    ans = malloc((size_t)g->n * sizeof(ans_t));
+    result = malloc((size_t)g->n * sizeof(ans_t));
+    cycle_ct = malloc((size_t)g->n * sizeof(uint64_t));
+#ifndef DYNAMIC_SCHEDULE
+#ifdef TOTAL_ONLY
+    gather_stride = 1;
+#else
+    for (uint32_t i = 0; i < g->part_num; i++) gather_stride = MAX(gather_stride, g->root_num[i]);
+#endif
+#ifdef PERF
+    gather_buf = malloc(2 * (size_t)g->part_num * gather_stride * sizeof(uint64_t));
+#else
+    gather_buf = malloc((size_t)g->part_num * gather_stride * sizeof(uint64_t));
+#endif
+#endif
+
+    bool fine = true;
+    if (socket_path) {
+        serve(socket_path, BUILT_PATTERNS, run_pattern);
+    }
+    else {
+        for (uint32_t i = 0; i < pattern_num; i++) {
+            ans_t total;
+            fine = run_pattern(patterns[i], &total) && fine;
+        }
+    }
     if (fine) printf(ANSI_COLOR_GREEN "All fine\n" ANSI_COLOR_RESET);
     else printf(ANSI_COLOR_RED "Some failed\n" ANSI_COLOR_RESET);
 
+    for (uint32_t i = 0; i < g->part_num; i++) {
+        free(g->roots[i]);
+        free(g->local_roots[i]);
+        free(g->split_range[i]);
+    }
+    free(g->root_num);
+    free(g->spare_num);
+    free(g->split_num);
+    free(g->roots);
+    free(g->local_roots);
+    free(g->split_range);
+    free(g->cpu_roots);
+    free(g->row_ptr);  // col_idx shares this allocation
     free(g);
+    free(ans);
+    free(result);
+    free(cycle_ct);
+    free(cycle_ct_dpu);
+#ifndef DYNAMIC_SCHEDULE
+    free(gather_buf);
+#endif
+#ifdef MULTI_PASS
+    epoch_free();
+    free(rank_first);
+#endif
     DPU_ASSERT(dpu_free(set));
     return 0;
 }
\ No newline at end of file
@@ -1,11 +1,18 @@
 #include <common.h>
+#include <parallel.h>
+#include <stdlib.h>
 
-node_t buf[32][MRAM_BUF_SIZE];
+// scratch sets of one thread, each as long as the largest row
+#define MINE_BUF_NUM 4
 
 extern node_t intersect(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c);
+extern node_t intersect_count(node_t *a, node_t a_size, node_t *b, node_t b_size);
+extern node_t intersect_below(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t bound, node_t *c);
+extern node_t intersect_count_below(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t bound);
 extern node_t difference(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c);
 
-ans_t clique2(Graph *g, node_t root) {
+ans_t clique2(Graph *g, node_t root, node_t **buf) {
+    (void)buf;
     edge_ptr root_begin = g->row_ptr[root];
     edge_ptr root_end = g->row_ptr[root + 1];
     ans_t ans = 0;
@@ -16,7 +23,8 @@ ans_t clique2(Graph *g, node_t root) {
     return ans;
 }
 
-ans_t clique3(Graph *g, node_t root) {
+ans_t clique3(Graph *g, node_t root, node_t **buf) {
+    (void)buf;
     edge_ptr root_begin = g->row_ptr[root];
     edge_ptr root_end = g->row_ptr[root + 1];
     ans_t ans = 0;
@@ -25,16 +33,32 @@ ans_t clique3(Graph *g, node_t root) {
         if (second_root >= root) break;
         edge_ptr second_root_begin = g->row_ptr[second_root];
         edge_ptr second_root_end = g->row_ptr[second_root + 1];
-        node_t common_size = intersect(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[second_root_begin], second_root_end - second_root_begin, buf[0]);
+        ans += intersect_count_below(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[second_root_begin], second_root_end - second_root_begin, second_root);
+    }
+    return ans;
+}
+
+ans_t clique4(Graph *g, node_t root, node_t **buf) {
+    edge_ptr root_begin = g->row_ptr[root];
+    edge_ptr root_end = g->row_ptr[root + 1];
+    ans_t ans = 0;
+    for (edge_ptr i = root_begin; i < root_end; i++) {
+        node_t second_root = g->col_idx[i];
+        if (second_root >= root) break;
+        edge_ptr second_root_begin = g->row_ptr[second_root];
+        edge_ptr second_root_end = g->row_ptr[second_root + 1];
+        node_t common_size = intersect_below(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[second_root_begin], second_root_end - second_root_begin, second_root, buf[0]);
         for (node_t j = 0; j < common_size; j++) {
-            if (buf[0][j] >= second_root) break;
-            ans++;
+            node_t third_root = buf[0][j];
+            edge_ptr third_root_begin = g->row_ptr[third_root];
+            edge_ptr third_root_end = g->row_ptr[third_root + 1];
+            ans += intersect_count_below(buf[0], j, &g->col_idx[third_root_begin], third_root_end - third_root_begin, third_root);
         }
     }
     return ans;
 }
 
-ans_t clique4(Graph *g, node_t root) {
+ans_t clique5(Graph *g, node_t root, node_t **buf) {
     edge_ptr root_begin = g->row_ptr[root];
     edge_ptr root_end = g->row_ptr[root + 1];
     ans_t ans = 0;
@@ -43,23 +67,25 @@ ans_t clique4(Graph *g, node_t root) {
         if (second_root >= root) break;
         edge_ptr second_root_begin = g->row_ptr[second_root];
         edge_ptr second_root_end = g->row_ptr[second_root + 1];
-        node_t common_size = intersect(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[second_root_begin], second_root_end - second_root_begin, buf[0]);
+        node_t common_size = intersect_below(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[second_root_begin], second_root_end - second_root_begin, second_root, buf[0]);
         for (node_t j = 0; j < common_size; j++) {
             node_t third_root = buf[0][j];
-            if (third_root >= second_root) break;
             edge_ptr third_root_begin = g->row_ptr[third_root];
             edge_ptr third_root_end = g->row_ptr[third_root + 1];
-            node_t common_size2 = intersect(buf[0], common_size, &g->col_idx[third_root_begin], third_root_end - third_root_begin, buf[1]);
+            node_t common_size2 = intersect_below(buf[0], j, &g->col_idx[third_root_begin], third_root_end - third_root_begin, third_root, buf[1]);
             for (node_t k = 0; k < common_size2; k++) {
-                if (buf[1][k] >= third_root) break;
-                ans++;
+                node_t fourth_root = buf[1][k];
+                edge_ptr fourth_root_begin = g->row_ptr[fourth_root];
+                edge_ptr fourth_root_end = g->row_ptr[fourth_root + 1];
+                ans += intersect_count_below(buf[1], k, &g->col_idx[fourth_root_begin], fourth_root_end - fourth_root_begin, fourth_root);
             }
         }
     }
     return ans;
 }
 
-ans_t cycle4(Graph *g, node_t root) {
+ans_t cycle4(Graph *g, node_t root, node_t **buf) {
+    (void)buf;
     edge_ptr root_begin = g->row_ptr[root];
     edge_ptr root_end = g->row_ptr[root + 1];
     ans_t ans = 0;
@@ -73,17 +99,13 @@ ans_t cycle4(Graph *g, node_t root) {
             if (third_root >= second_root) break;
             edge_ptr third_root_begin = g->row_ptr[third_root];
             edge_ptr third_root_end = g->row_ptr[third_root + 1];
-            node_t common_size = intersect(&g->col_idx[second_root_begin], second_root_end - second_root_begin, &g->col_idx[third_root_begin], third_root_end - third_root_begin, buf[1]);
-            for (node_t k = 0; k < common_size; k++) {
-                if (buf[1][k] >= root) break;
-                ans++;
-            }
+            ans += intersect_count_below(&g->col_idx[second_root_begin], second_root_end - second_root_begin, &g->col_idx[third_root_begin], third_root_end - third_root_begin, root);
         }
     }
     return ans;
 }
 
-ans_t house5(Graph *g, node_t root) {
+ans_t house5(Graph *g, node_t root, node_t **buf) {
     edge_ptr root_begin = g->row_ptr[root];
     edge_ptr root_end = g->row_ptr[root + 1];
     ans_t ans = 0;
@@ -106,14 +128,14 @@ ans_t house5(Graph *g, node_t root) {
                     break;
                 }
             }
-            node_t common_size = intersect(buf[0], fifth_root_size, buf[1], fourth_root_size, buf[2]);
+            node_t common_size = intersect_count(buf[0], fifth_root_size, buf[1], fourth_root_size);
             ans += ((ans_t)cur_fifth) * (fourth_root_size - 1) - common_size;
         }
     }
     return ans;
 }
 
-ans_t tri_tri6(Graph *g, node_t root) {
+ans_t tri_tri6(Graph *g, node_t root, node_t **buf) {
     edge_ptr root_begin = g->row_ptr[root];
     edge_ptr root_end = g->row_ptr[root + 1];
     ans_t ans = 0;
@@ -129,10 +151,77 @@ ans_t tri_tri6(Graph *g, node_t root) {
             edge_ptr third_root_begin = g->row_ptr[third_root];
             edge_ptr third_root_end = g->row_ptr[third_root + 1];
             node_t common_size2 = intersect(&g->col_idx[second_root_begin], second_root_end - second_root_begin, &g->col_idx[third_root_begin], third_root_end - third_root_begin, buf[1]);
-            node_t common_size3 = intersect(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[third_root_begin], third_root_end - third_root_begin, buf[2]);
-            node_t common_size123 = intersect(buf[0], common_size, buf[1], common_size2, buf[3]);
+            node_t common_size3 = intersect_count(&g->col_idx[root_begin], root_end - root_begin, &g->col_idx[third_root_begin], third_root_end - third_root_begin);
+            node_t common_size123 = intersect_count(buf[0], common_size, buf[1], common_size2);
             ans += ((ans_t)common_size - 1) * (common_size2 - 1) * (common_size3 - 1) - ((ans_t)common_size123) * (((ans_t)common_size) + common_size2 + common_size3 - 5);
         }
     }
     return ans;
-}
\ No newline at end of file
+}
+#ifdef GENERATED
+// host reference written by bin/codegen
+extern ans_t GENERATED_FUNC(Graph *g, node_t root, node_t **buf);
+#define GENERATED_KERNEL GENERATED_FUNC
+#else
+#define GENERATED_NAME "generated"
+#define GENERATED_KERNEL NULL
+#endif
+
+// indexed by the PATTERN_* ids
+const char *const pattern_names[NR_PATTERNS] = {"clique2", "clique3", "clique4", "clique5", "cycle4", "house5", "tri_tri6", GENERATED_NAME};
+ans_t (*const pattern_kernels[NR_PATTERNS])(Graph *g, node_t root, node_t **buf) = {clique2, clique3, clique4, clique5, cycle4, house5, tri_tri6, GENERATED_KERNEL};
+
+typedef struct MineArgs {
+    Graph *g;
+    ans_t (*kernel)(Graph *g, node_t root, node_t **buf);
+    const node_t *roots;   // NULL for every vertex
+    uint64_t root_num;
+    uint64_t next;   // next root to claim
+    size_t buf_size;
+    ans_t *result;
+    ans_t total[MAX_HOST_THREADS];
+} MineArgs;
+
+// roots are claimed one at a time, callers pass them heaviest first so the tail stays short
+static void mine_worker(uint32_t tid, uint32_t nr_threads, void *arg) {
+    MineArgs *args = arg;
+    (void)nr_threads;
+    node_t *buf[MINE_BUF_NUM];
+    for (uint32_t i = 0; i < MINE_BUF_NUM; i++) {
+        buf[i] = malloc(args->buf_size * sizeof(node_t));
+    }
+    ans_t total = 0;
+    uint64_t i;
+    while ((i = __atomic_fetch_add(&args->next, 1, __ATOMIC_RELAXED)) < args->root_num) {
+        node_t root = args->roots ? args->roots[i] : (node_t)i;
+        ans_t ans = args->kernel(args->g, root, buf);
+        if (args->result) args->result[root] = ans;
+        total += ans;
+    }
+    args->total[tid] = total;
+    for (uint32_t i = 0; i < MINE_BUF_NUM; i++) {
+        free(buf[i]);
+    }
+}
+
+// count pattern at roots on all host threads, the answer of every root goes to result[root] unless it is NULL
+ans_t cpu_mine(Graph *g, uint32_t pattern, const node_t *roots, uint64_t root_num, ans_t *result) {
+    static MineArgs args;
+    args.g = g;
+    args.kernel = pattern_kernels[pattern];
+    args.roots = roots;
+    args.root_num = root_num;
+    args.next = 0;
+    args.result = result;
+    node_t max_deg = 0;
+    for (node_t i = 0; i < g->n; i++) {
+        max_deg = MAX(max_deg, g->row_ptr[i + 1] - g->row_ptr[i]);
+    }
+    args.buf_size = (size_t)max_deg + SET_OP_SLACK;
+    parallel_run(mine_worker, &args);
+    ans_t total = 0;
+    for (uint32_t i = 0; i < host_thread_num(); i++) {
+        total += args.total[i];
+    }
+    return total;
+}
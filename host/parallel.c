@@ -0,0 +1,51 @@
+#define _DEFAULT_SOURCE
+#include <common.h>
+#include <parallel.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct ThreadArgs {
+    parallel_func_t func;
+    void *arg;
+    uint32_t tid;
+    uint32_t nr_threads;
+} ThreadArgs;
+
+uint32_t host_thread_num() {
+    static uint32_t nr_threads = 0;
+    if (nr_threads == 0) {
+        long online = NR_HOST_THREADS > 0 ? NR_HOST_THREADS : sysconf(_SC_NPROCESSORS_ONLN);
+        nr_threads = online < 1 ? 1 : MIN(online, MAX_HOST_THREADS);
+    }
+    return nr_threads;
+}
+
+static void *thread_entry(void *arg) {
+    ThreadArgs *args = arg;
+    args->func(args->tid, args->nr_threads, args->arg);
+    return NULL;
+}
+
+// run func on every host thread, the calling thread takes tid 0
+void parallel_run(parallel_func_t func, void *arg) {
+    uint32_t nr_threads = host_thread_num();
+    pthread_t threads[MAX_HOST_THREADS];
+    ThreadArgs args[MAX_HOST_THREADS];
+    for (uint32_t i = 0; i < nr_threads; i++) {
+        args[i].func = func;
+        args[i].arg = arg;
+        args[i].tid = i;
+        args[i].nr_threads = nr_threads;
+    }
+    for (uint32_t i = 1; i < nr_threads; i++) {
+        if (pthread_create(&threads[i], NULL, thread_entry, &args[i]) != 0) {
+            printf(ANSI_COLOR_RED "Error: cannot create host thread\n" ANSI_COLOR_RESET);
+            exit(1);
+        }
+    }
+    func(0, nr_threads, arg);
+    for (uint32_t i = 1; i < nr_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
@@ -1,27 +1,50 @@
+#define _DEFAULT_SOURCE
 #include <common.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <parallel.h>
+#include <partition.h>
 #include <dpu.h>
 #include <dpu_types.h>
 
-Graph *global_g;
-double workload[N];
+// the .bin file mapped read-only: n, m, row_ptr[n], col_idx[m]
+typedef struct MappedGraph {
+    node_t n;
+    edge_ptr m;
+    const edge_ptr *row_ptr;  // row_ptr[n] is not stored, use mapped_row_end()
+    const node_t *col_idx;
+    void *addr;
+    size_t size;
+} MappedGraph;
 
-static int deg_cmp(const void *a, const void *b) {
-    node_t x = *(node_t *)a;
-    node_t y = *(node_t *)b;
-    return global_g->row_ptr[y + 1] - global_g->row_ptr[y] - (global_g->row_ptr[x + 1] - global_g->row_ptr[x]);
-}
-static int node_t_cmp(const void *a, const void *b) {
-    node_t x = *(node_t *)a;
-    node_t y = *(node_t *)b;
-    return x - y;
+static inline edge_ptr mapped_row_end(const MappedGraph *src, node_t v) {
+    return v + 1 < src->n ? src->row_ptr[v + 1] : src->m;
 }
+
+Graph *global_g;
+double *workload;
+#ifdef ALL_PATTERNS
+uint32_t pattern_set;  // patterns of the session, the allocation balances their summed workload
+#else
+uint32_t pattern_set = 1u << PATTERN_ID;
+#endif
+#ifdef DEGENERACY_ORDER
+node_t *core_num;  // core number by new id
+#endif
+size_t bitmap_words;  // words per dpu bitmap
+
 static int workload_cmp(const void *a, const void *b) {
     node_t x = *(node_t *)a;
     node_t y = *(node_t *)b;
-    return workload[y] - workload[x];
+    return (workload[y] > workload[x]) - (workload[y] < workload[x]);
 }
 
 #ifdef MORE_ACCURATE_MODEL
@@ -38,40 +61,62 @@ static inline double predict_workload(Graph *g, node_t root) {
         }
     }
     double eff_deg = eff_deg = l - g->row_ptr[root];
+#ifndef HYBRID_CPU
     if (deg > MRAM_BUF_SIZE) {
-        printf(ANSI_COLOR_RED "Error: deg too large\n" ANSI_COLOR_RESET);
+        printf(ANSI_COLOR_RED "Error: deg too large, HYBRID_CPU runs such roots on the host\n" ANSI_COLOR_RESET);
         exit(1);
     }
     if (eff_deg > BITMAP_SIZE * 32) {
-        printf(ANSI_COLOR_RED "Error: eff_deg too large\n" ANSI_COLOR_RESET);
+        printf(ANSI_COLOR_RED "Error: eff_deg too large, HYBRID_CPU runs such roots on the host\n" ANSI_COLOR_RESET);
         exit(1);
     }
+#endif
     double avg_deg = 0;
     for (edge_ptr i = g->row_ptr[root]; i < g->row_ptr[root + 1]; i++) {
         node_t neighbor = g->col_idx[i];
+#ifdef DEGENERACY_ORDER
+        // deeper levels only scan lower ranked neighbors, which the core number bounds
+        avg_deg += MIN(core_num[neighbor], g->row_ptr[neighbor + 1] - g->row_ptr[neighbor]);
+#else
         avg_deg += g->row_ptr[neighbor + 1] - g->row_ptr[neighbor];
+#endif
     }
-    avg_deg /= g->row_ptr[root + 1] - g->row_ptr[root];
+    // a sink of the oriented graph has no neighbors, its workload is the constant term alone
+    if (deg > 0) avg_deg /= deg;
     double n = global_g->n;
-    (void)deg;
-    (void)eff_deg;
-    (void)avg_deg;
-    (void)n;
-#if defined(CLIQUE2)
-    return eff_deg;
-#elif defined(CLIQUE3)
-    return eff_deg * eff_deg * avg_deg + 100;
-#elif defined(CLIQUE4)
-    return eff_deg * eff_deg * eff_deg * avg_deg * avg_deg * avg_deg + 100;
-#elif defined(CLIQUE5)
-    return eff_deg * eff_deg * eff_deg * eff_deg * avg_deg * avg_deg * avg_deg * avg_deg * avg_deg * avg_deg + 100;
-#elif defined(CYCLE4)
-    return eff_deg * eff_deg * avg_deg + 100;
-#elif defined(HOUSE5)
-    return eff_deg * deg * avg_deg * (2 + deg / n + avg_deg / n) + 100;
-#elif defined(TRI_TRI6)
-    return eff_deg * eff_deg * avg_deg * (deg + 3 * avg_deg + (deg + avg_deg) * avg_deg / n) + 100;
+    double total = 0;
+    for (uint32_t pattern = 0; pattern < NR_PATTERNS; pattern++) {
+        if (!(pattern_set >> pattern & 1)) continue;
+        switch (pattern) {
+        case PATTERN_CLIQUE2:
+            total += eff_deg;
+            break;
+        case PATTERN_CLIQUE3:
+            total += eff_deg * eff_deg * avg_deg + 100;
+            break;
+        case PATTERN_CLIQUE4:
+            total += eff_deg * eff_deg * eff_deg * avg_deg * avg_deg * avg_deg + 100;
+            break;
+        case PATTERN_CLIQUE5:
+            total += eff_deg * eff_deg * eff_deg * eff_deg * avg_deg * avg_deg * avg_deg * avg_deg * avg_deg * avg_deg + 100;
+            break;
+        case PATTERN_CYCLE4:
+            total += eff_deg * eff_deg * avg_deg + 100;
+            break;
+        case PATTERN_HOUSE5:
+            total += eff_deg * deg * avg_deg * (2 + deg / n + avg_deg / n) + 100;
+            break;
+        case PATTERN_TRI_TRI6:
+            total += eff_deg * eff_deg * avg_deg * (deg + 3 * avg_deg + (deg + avg_deg) * avg_deg / n) + 100;
+            break;
+#ifdef GENERATED
+        case PATTERN_GENERATED:
+            total += GENERATED_WORKLOAD(deg, eff_deg, avg_deg, n) + 100;
+            break;
 #endif
+        }
+    }
+    return total;
 }
 #else
 static inline double predict_workload(Graph *g, node_t root) {
@@ -87,335 +132,1804 @@ static inline double predict_workload(Graph *g, node_t root) {
         }
     }
     double eff_deg = eff_deg = l - g->row_ptr[root];
+#ifndef HYBRID_CPU
     if (deg > MRAM_BUF_SIZE) {
-        printf(ANSI_COLOR_RED "Error: deg too large\n" ANSI_COLOR_RESET);
+        printf(ANSI_COLOR_RED "Error: deg too large, HYBRID_CPU runs such roots on the host\n" ANSI_COLOR_RESET);
         exit(1);
     }
     if (eff_deg > BITMAP_SIZE * 32) {
-        printf(ANSI_COLOR_RED "Error: eff_deg too large\n" ANSI_COLOR_RESET);
+        printf(ANSI_COLOR_RED "Error: eff_deg too large, HYBRID_CPU runs such roots on the host\n" ANSI_COLOR_RESET);
         exit(1);
     }
+#endif
     double avg_deg = (double)global_g->m / global_g->n;
     double n = global_g->n;
-    (void)deg;
-    (void)eff_deg;
-    (void)avg_deg;
-    (void)n;
-#if defined(CLIQUE2)
-    return eff_deg;
-#elif defined(CLIQUE3)
-    return eff_deg * eff_deg + 100;
-#elif defined(CLIQUE4)
-    return eff_deg * eff_deg * eff_deg + 100;
-#elif defined(CLIQUE5)
-    return eff_deg * eff_deg * eff_deg * eff_deg + 100;
-#elif defined(CYCLE4)
-    return eff_deg * eff_deg + 100;
-#elif defined(HOUSE5)
-    return eff_deg * deg * (2 + deg / n + avg_deg / n) + 100;
-#elif defined(TRI_TRI6)
-    return eff_deg * eff_deg * (deg + 3 * avg_deg + (deg + avg_deg) * avg_deg / n) + 100;
-#endif
-}
-#endif
-
-static void read_input() {
-    FILE *fin = fopen(DATA_PATH, "rb");
+    double total = 0;
+    for (uint32_t pattern = 0; pattern < NR_PATTERNS; pattern++) {
+        if (!(pattern_set >> pattern & 1)) continue;
+        switch (pattern) {
+        case PATTERN_CLIQUE2:
+            total += eff_deg;
+            break;
+        case PATTERN_CLIQUE3:
+            total += eff_deg * eff_deg + 100;
+            break;
+        case PATTERN_CLIQUE4:
+            total += eff_deg * eff_deg * eff_deg + 100;
+            break;
+        case PATTERN_CLIQUE5:
+            total += eff_deg * eff_deg * eff_deg * eff_deg + 100;
+            break;
+        case PATTERN_CYCLE4:
+            total += eff_deg * eff_deg + 100;
+            break;
+        case PATTERN_HOUSE5:
+            total += eff_deg * deg * (2 + deg / n + avg_deg / n) + 100;
+            break;
+        case PATTERN_TRI_TRI6:
+            total += eff_deg * eff_deg * (deg + 3 * avg_deg + (deg + avg_deg) * avg_deg / n) + 100;
+            break;
+#ifdef GENERATED
+        case PATTERN_GENERATED:
+            total += GENERATED_WORKLOAD(deg, eff_deg, avg_deg, n) + 100;
+            break;
+#endif
+        }
+    }
+    return total;
+}
+#endif
+
+#ifdef PROFILE_MODEL
+// per-root cycle counts written by a previous PERF run
+typedef struct Profile {
     node_t n;
     edge_ptr m;
-    edge_ptr *row_ptr = global_g->row_ptr;
-    node_t *col_idx = global_g->col_idx;
-    fread(&n, sizeof(node_t), 1, fin);
-    fread(&m, sizeof(edge_ptr), 1, fin);
-    fread(row_ptr, sizeof(edge_ptr), n, fin);
-    fread(col_idx, sizeof(node_t), m, fin);
-    row_ptr[n] = m;
-    fclose(fin);
-    global_g->n = n;
-    global_g->m = m;
+    uint64_t *data;   // deg[n], o_deg[n], cycle[n]
+    bool per_root;   // same renumbered graph, the cycles are used as they are
+    bool fitted;
+    double coef[3];   // log(cycle) ~ coef[0] + coef[1] * log(o_deg + 1) + coef[2] * log(deg + 1)
+} Profile;
+Profile profile;
+
+// least squares over the profiled roots on centered logs, the small ridge keeps the system
+// solvable when o_deg and deg are collinear, as in oriented graphs
+static bool profile_fit() {
+    double sum[3] = {0}, cov[3][3] = {{0}};
+    uint64_t samples = 0;
+    for (node_t i = 0; i < profile.n; i++) {
+        uint64_t cycle = profile.data[2 * (size_t)profile.n + i];
+        if (!cycle) continue;
+        double x[3] = {log(profile.data[(size_t)profile.n + i] + 1.0), log(profile.data[i] + 1.0), log((double)cycle)};
+        for (uint32_t r = 0; r < 3; r++) {
+            sum[r] += x[r];
+            for (uint32_t c = 0; c < 3; c++) {
+                cov[r][c] += x[r] * x[c];
+            }
+        }
+        samples++;
+    }
+    if (samples < 3) return false;
+    for (uint32_t r = 0; r < 3; r++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            cov[r][c] -= sum[r] * sum[c] / samples;
+        }
+    }
+    double ridge = PROFILE_RIDGE * (cov[0][0] + cov[1][1]);
+    double a = cov[0][0] + ridge, b = cov[0][1], d = cov[1][1] + ridge;
+    double det = a * d - b * b;
+    if (det <= 0) return false;
+    profile.coef[1] = (d * cov[0][2] - b * cov[1][2]) / det;
+    profile.coef[2] = (a * cov[1][2] - b * cov[0][2]) / det;
+    profile.coef[0] = (sum[2] - profile.coef[1] * sum[0] - profile.coef[2] * sum[1]) / samples;
+    return true;
 }
 
-static void data_renumber() {
-    static node_t rank[N];
-    static node_t renumbered[N];
-    Graph *tmp_g = malloc(sizeof(Graph));
-    memcpy(tmp_g, global_g, sizeof(Graph));
-    for (node_t i = 0; i < global_g->n; i++) {
-        rank[i] = i;
+// RESULT_DIR "<pattern>_<graph>.txt" as written by main(), a missing or malformed file
+// leaves the analytic model in place
+static void load_profile(const char *data_path) {
+    const char *base = strrchr(data_path, '/');
+    base = base ? base + 1 : data_path;
+    const char *ext = strrchr(base, '.');
+    int len = ext ? (int)(ext - base) : (int)strlen(base);
+    char path[512];
+    snprintf(path, sizeof(path), RESULT_DIR PATTERN_NAME "_%.*s.txt", len, base);
+    memset(&profile, 0, sizeof(profile));
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        printf("No profile %s, using the analytic workload model\n", path);
+        return;
     }
-    qsort(rank, global_g->n, sizeof(node_t), deg_cmp);
-    for (node_t i = 0; i < global_g->n; i++) {
-        renumbered[rank[i]] = i;
+
+    char line[256];
+    bool fine = fgets(line, sizeof(line), fp) && fgets(line, sizeof(line), fp) && sscanf(line, "N: %u, M: %u", &profile.n, &profile.m) == 2;
+    if (fine) {
+        profile.data = malloc(3 * (size_t)profile.n * sizeof(uint64_t));
     }
-    edge_ptr cur = 0;
-    for (node_t i = 0; i < global_g->n; i++) {
+    for (node_t i = 0; fine && i < profile.n; i++) {
+        node_t node, deg;
+        uint64_t o_deg, cycle;
+        fine = fgets(line, sizeof(line), fp) && sscanf(line, "node: %u, deg: %u, o_deg: %lu, ans: %*u, cycle: %lu", &node, &deg, &o_deg, &cycle) == 4 && node == i;
+        if (!fine) {
+            break;
+        }
+        profile.data[i] = deg;
+        profile.data[(size_t)profile.n + i] = o_deg;
+        profile.data[2 * (size_t)profile.n + i] = cycle;
+    }
+    fclose(fp);
+    if (!fine) {
+        printf("Ignoring malformed profile %s\n", path);
+        free(profile.data);
+        profile.data = NULL;
+        return;
+    }
+    profile.fitted = profile_fit();
+    if (profile.fitted) {
+        printf("Profile %s: cycle ~ %.3g * (o_deg + 1)^%.3f * (deg + 1)^%.3f\n", path, exp(profile.coef[0]), profile.coef[1], profile.coef[2]);
+    }
+}
+
+// the measured cycles can only be reused when the run renumbered the graph the same way
+static void check_profile() {
+    if (!profile.data || profile.n != global_g->n || profile.m != global_g->m) return;
+    for (node_t i = 0; i < profile.n; i++) {
+        if (profile.data[i] != global_g->row_ptr[i + 1] - global_g->row_ptr[i]) return;
+    }
+    profile.per_root = true;
+    printf("Using the per-root cycles of the profile\n");
+}
+
+// 0 when the profile has nothing for root
+static inline double profile_workload(Graph *g, node_t root) {
+    // roots the host ran with HYBRID_CPU have no cycle count, the fit covers them
+    if (profile.per_root && profile.data[2 * (size_t)profile.n + root]) {
+        return profile.data[2 * (size_t)profile.n + root] + 1;
+    }
+    if (!profile.fitted) return 0;
+    edge_ptr l = g->row_ptr[root], r = g->row_ptr[root + 1];
+    while (l < r) {
+        edge_ptr mid = (l + r) >> 1;
+        if (g->col_idx[mid] < root) {
+            l = mid + 1;
+        }
+        else {
+            r = mid;
+        }
+    }
+    double o_deg = l - g->row_ptr[root];
+    double deg = g->row_ptr[root + 1] - g->row_ptr[root];
+    return exp(profile.coef[0] + profile.coef[1] * log(o_deg + 1) + profile.coef[2] * log(deg + 1));
+}
+#endif
+
+static void read_input(const char *path, MappedGraph *src) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf(ANSI_COLOR_RED "Error: cannot open %s\n" ANSI_COLOR_RESET, path);
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(node_t) + sizeof(edge_ptr)) {
+        printf(ANSI_COLOR_RED "Error: bad header in %s\n" ANSI_COLOR_RESET, path);
+        exit(1);
+    }
+    src->size = st.st_size;
+    src->addr = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (src->addr == MAP_FAILED) {
+        printf(ANSI_COLOR_RED "Error: cannot map %s\n" ANSI_COLOR_RESET, path);
+        exit(1);
+    }
+    const uint32_t *header = src->addr;
+    src->n = header[0];
+    src->m = header[1];
+    src->row_ptr = (const edge_ptr *)(header + 2);
+    src->col_idx = (const node_t *)(src->row_ptr + src->n);
+    if (src->size < sizeof(node_t) + sizeof(edge_ptr) + (size_t)src->n * sizeof(edge_ptr) + (size_t)src->m * sizeof(node_t)) {
+        printf(ANSI_COLOR_RED "Error: truncated graph %s\n" ANSI_COLOR_RESET, path);
+        exit(1);
+    }
+    madvise(src->addr, src->size, MADV_WILLNEED);
+}
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define ROW_RADIX_BITS 8
+#define ROW_RADIX_SIZE (1 << ROW_RADIX_BITS)
+#define ROW_INSERTION_SORT 64
+
+typedef struct RenumberArgs {
+    const MappedGraph *src;
+    node_t *deg;   // degree in original id
+    node_t *rank;   // new id -> original id
+    node_t *tmp;
+    node_t *renumbered;   // original id -> new id
+    node_t *row_deg;   // row size in new id
+    node_t max_deg[MAX_HOST_THREADS];
+    uint32_t shift;   // current radix digit
+    uint32_t (*hist)[RADIX_SIZE];   // per thread digit offsets
+    edge_ptr row_sum[MAX_HOST_THREADS];
+} RenumberArgs;
+
+// first row starting at or after edge e
+static node_t lower_bound_row(const edge_ptr *row_ptr, node_t n, uint64_t e) {
+    node_t l = 0, r = n;
+    while (l < r) {
+        node_t mid = l + ((r - l) >> 1);
+        if (row_ptr[mid] < e) {
+            l = mid + 1;
+        }
+        else {
+            r = mid;
+        }
+    }
+    return l;
+}
+
+static void renumber_degree(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    const MappedGraph *src = args->src;
+    uint64_t begin, end;
+    parallel_range(src->n, tid, nr_threads, &begin, &end);
+    node_t max_deg = 0;
+    for (node_t v = begin; v < end; v++) {
+        args->deg[v] = mapped_row_end(src, v) - src->row_ptr[v];
+        args->rank[v] = v;
+        if (args->deg[v] > max_deg) max_deg = args->deg[v];
+    }
+    args->max_deg[tid] = max_deg;
+}
+
+#ifndef DEGENERACY_ORDER
+// descending degree as an ascending key, so a stable sort keeps ties in original id order
+static inline uint32_t rank_digit(RenumberArgs *args, node_t v) {
+    return ((args->max_deg[0] - args->deg[v]) >> args->shift) & (RADIX_SIZE - 1);
+}
+
+static void renumber_rank_hist(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(args->src->n, tid, nr_threads, &begin, &end);
+    uint32_t *hist = args->hist[tid];
+    memset(hist, 0, RADIX_SIZE * sizeof(uint32_t));
+    for (uint64_t i = begin; i < end; i++) {
+        hist[rank_digit(args, args->rank[i])]++;
+    }
+}
+
+static void renumber_rank_scatter(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(args->src->n, tid, nr_threads, &begin, &end);
+    uint32_t *offset = args->hist[tid];
+    for (uint64_t i = begin; i < end; i++) {
+        node_t v = args->rank[i];
+        args->tmp[offset[rank_digit(args, v)]++] = v;
+    }
+}
+
+// stable LSD radix sort of all vertices by descending degree
+static void renumber_rank(RenumberArgs *args, uint32_t nr_threads) {
+    for (args->shift = 0; args->shift < 32 && (args->shift == 0 || (args->max_deg[0] >> args->shift)); args->shift += RADIX_BITS) {
+        parallel_run(renumber_rank_hist, args);
+        uint32_t sum = 0;
+        for (uint32_t d = 0; d < RADIX_SIZE; d++) {
+            for (uint32_t t = 0; t < nr_threads; t++) {
+                uint32_t count = args->hist[t][d];
+                args->hist[t][d] = sum;
+                sum += count;
+            }
+        }
+        parallel_run(renumber_rank_scatter, args);
+        node_t *swap = args->rank;
+        args->rank = args->tmp;
+        args->tmp = swap;
+    }
+}
+#else
+// bucket based core decomposition in O(n + m), vertices peeled last get the smallest ids
+// so that every vertex has at most its core number of lower ranked neighbors
+static void renumber_degeneracy(RenumberArgs *args) {
+    const MappedGraph *src = args->src;
+    node_t n = src->n;
+    node_t max_deg = args->max_deg[0];
+    node_t *core = malloc((size_t)n * sizeof(node_t));   // remaining degree, then core number
+    node_t *vert = args->tmp;   // vertices in peeling order
+    node_t *pos = args->rank;   // position of each vertex in vert
+    node_t *bin = calloc((size_t)max_deg + 1, sizeof(node_t));   // first position of each degree
+
+    memcpy(core, args->deg, (size_t)n * sizeof(node_t));
+    for (node_t v = 0; v < n; v++) {
+        bin[core[v]]++;
+    }
+    node_t start = 0;
+    for (node_t d = 0; d <= max_deg; d++) {
+        node_t num = bin[d];
+        bin[d] = start;
+        start += num;
+    }
+    for (node_t v = 0; v < n; v++) {
+        pos[v] = bin[core[v]]++;
+        vert[pos[v]] = v;
+    }
+    for (node_t d = max_deg; d > 0; d--) {
+        bin[d] = bin[d - 1];
+    }
+    bin[0] = 0;
+
+    node_t degeneracy = 0;
+    for (node_t i = 0; i < n; i++) {
+        node_t v = vert[i];
+        if (core[v] > degeneracy) degeneracy = core[v];
+        for (edge_ptr j = src->row_ptr[v]; j < src->row_ptr[v] + args->deg[v]; j++) {
+            node_t u = src->col_idx[j];
+            if (core[u] > core[v]) {
+                // move u to the front of its bucket and shrink the bucket by one
+                node_t du = core[u];
+                node_t pu = pos[u];
+                node_t pw = bin[du];
+                node_t w = vert[pw];
+                if (u != w) {
+                    pos[u] = pw;
+                    vert[pu] = w;
+                    pos[w] = pu;
+                    vert[pw] = u;
+                }
+                bin[du]++;
+                core[u]--;
+            }
+        }
+    }
+    printf("Degeneracy: %u\n", degeneracy);
+
+    // reverse the peeling order, pos is no longer needed
+    node_t *rank = args->rank;
+    core_num = malloc((size_t)n * sizeof(node_t));
+    for (node_t i = 0; i < n; i++) {
+        rank[i] = vert[n - 1 - i];
+        core_num[i] = core[rank[i]];
+    }
+    free(core);
+    free(bin);
+}
+#endif
+
+static void renumber_inverse(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(args->src->n, tid, nr_threads, &begin, &end);
+    for (node_t i = begin; i < end; i++) {
+        args->renumbered[args->rank[i]] = i;
+    }
+}
+
+static void renumber_row_size(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    const MappedGraph *src = args->src;
+    uint64_t begin, end;
+    parallel_range(src->n, tid, nr_threads, &begin, &end);
+    edge_ptr sum = 0;
+    for (node_t i = begin; i < end; i++) {
+        node_t node = args->rank[i];
+#ifdef ORIENTED
+        // keep only the lower ranked neighbors
+        node_t out_deg = 0;
+        for (edge_ptr j = src->row_ptr[node]; j < src->row_ptr[node] + args->deg[node]; j++) {
+            if (args->renumbered[src->col_idx[j]] < i) out_deg++;
+        }
+        args->row_deg[i] = out_deg;
+#else
+        args->row_deg[i] = args->deg[node];
+#endif
+        sum += args->row_deg[i];
+    }
+    args->row_sum[tid] = sum;
+}
+
+static void renumber_row_ptr(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(args->src->n, tid, nr_threads, &begin, &end);
+    edge_ptr cur = args->row_sum[tid];
+    for (node_t i = begin; i < end; i++) {
         global_g->row_ptr[i] = cur;
-        node_t node = rank[i];
-        for (edge_ptr j = tmp_g->row_ptr[node]; j < tmp_g->row_ptr[node + 1]; j++) {
-            global_g->col_idx[cur++] = renumbered[tmp_g->col_idx[j]];
+        cur += args->row_deg[i];
+    }
+}
+
+static void sort_row(node_t *row, node_t size, node_t *tmp, uint32_t key_bits) {
+    if (size <= ROW_INSERTION_SORT) {
+        for (node_t i = 1; i < size; i++) {
+            node_t val = row[i];
+            node_t j = i;
+            while (j > 0 && row[j - 1] > val) {
+                row[j] = row[j - 1];
+                j--;
+            }
+            row[j] = val;
+        }
+        return;
+    }
+    uint32_t offset[ROW_RADIX_SIZE];
+    node_t *in = row, *out = tmp;
+    for (uint32_t shift = 0; shift < key_bits; shift += ROW_RADIX_BITS) {
+        memset(offset, 0, sizeof(offset));
+        for (node_t i = 0; i < size; i++) {
+            offset[(in[i] >> shift) & (ROW_RADIX_SIZE - 1)]++;
+        }
+        uint32_t sum = 0;
+        for (uint32_t d = 0; d < ROW_RADIX_SIZE; d++) {
+            uint32_t count = offset[d];
+            offset[d] = sum;
+            sum += count;
+        }
+        for (node_t i = 0; i < size; i++) {
+            out[offset[(in[i] >> shift) & (ROW_RADIX_SIZE - 1)]++] = in[i];
         }
-        qsort(global_g->col_idx + global_g->row_ptr[i], cur - global_g->row_ptr[i], sizeof(node_t), node_t_cmp);
+        node_t *swap = in;
+        in = out;
+        out = swap;
+    }
+    if (in != row) {
+        memcpy(row, in, size * sizeof(node_t));
     }
-    free(tmp_g);
 }
 
-static inline bool check_in_bitmap(node_t n, uint32_t bitmap[N >> 5]) {
+// rows are split by edge count so that hub vertices do not pile up on one thread
+static void renumber_col_idx(uint32_t tid, uint32_t nr_threads, void *arg) {
+    RenumberArgs *args = arg;
+    const MappedGraph *src = args->src;
+    node_t n = src->n;
+    edge_ptr *row_ptr = global_g->row_ptr;
+    uint64_t edge_begin, edge_end;
+    parallel_range(global_g->m, tid, nr_threads, &edge_begin, &edge_end);
+    node_t begin = tid == 0 ? 0 : lower_bound_row(row_ptr, n, edge_begin);
+    node_t end = tid + 1 == nr_threads ? n : lower_bound_row(row_ptr, n, edge_end);
+
+    uint32_t key_bits = 0;
+    while (key_bits < 32 && (n - 1) >> key_bits) key_bits += ROW_RADIX_BITS;
+    node_t *tmp = malloc(((size_t)args->max_deg[0] + 1) * sizeof(node_t));
+    for (node_t i = begin; i < end; i++) {
+        node_t node = args->rank[i];
+        node_t *row = &global_g->col_idx[row_ptr[i]];
+        const node_t *old_row = &src->col_idx[src->row_ptr[node]];
+#ifdef ORIENTED
+        for (node_t j = 0, k = 0; j < args->deg[node]; j++) {
+            node_t neighbor = args->renumbered[old_row[j]];
+            if (neighbor < i) row[k++] = neighbor;
+        }
+#else
+        for (node_t j = 0; j < args->deg[node]; j++) {
+            row[j] = args->renumbered[old_row[j]];
+        }
+#endif
+        sort_row(row, args->row_deg[i], tmp, key_bits);
+    }
+    free(tmp);
+}
+
+// renumber straight from the mapped pages into one fresh buffer holding row_ptr and col_idx,
+// ordered by descending degree with ties kept in original id order, or by reversed k-core
+// peeling order with DEGENERACY_ORDER
+static void data_renumber(MappedGraph *src) {
+    node_t n = src->n;
+    uint32_t nr_threads = host_thread_num();
+    RenumberArgs args;
+    args.src = src;
+    args.deg = malloc((size_t)n * sizeof(node_t));
+    args.rank = malloc((size_t)n * sizeof(node_t));
+    args.tmp = malloc((size_t)n * sizeof(node_t));
+    args.hist = malloc(nr_threads * sizeof(*args.hist));
+
+    parallel_run(renumber_degree, &args);
+    for (uint32_t t = 1; t < nr_threads; t++) {
+        if (args.max_deg[t] > args.max_deg[0]) args.max_deg[0] = args.max_deg[t];
+    }
+#ifdef DEGENERACY_ORDER
+    renumber_degeneracy(&args);
+#else
+    renumber_rank(&args, nr_threads);
+#endif
+    args.renumbered = args.tmp;
+    parallel_run(renumber_inverse, &args);
+
+    args.row_deg = malloc((size_t)n * sizeof(node_t));
+    parallel_run(renumber_row_size, &args);
+    edge_ptr m = 0;
+    for (uint32_t t = 0; t < nr_threads; t++) {
+        edge_ptr count = args.row_sum[t];
+        args.row_sum[t] = m;
+        m += count;
+    }
+
+    // padded so that ALIGN8 transfers never read past the end
+    size_t row_size = ALIGN2((size_t)n + 1);
+    global_g->n = n;
+    global_g->m = m;
+    global_g->row_ptr = malloc((row_size + ALIGN2((size_t)m)) * sizeof(node_t));
+    global_g->col_idx = (node_t *)(global_g->row_ptr + row_size);
+    parallel_run(renumber_row_ptr, &args);
+    global_g->row_ptr[n] = m;
+    parallel_run(renumber_col_idx, &args);
+
+    free(args.deg);
+    free(args.row_deg);
+    free(args.rank);
+    free(args.tmp);
+    free(args.hist);
+    munmap(src->addr, src->size);
+}
+
+static inline bool check_in_bitmap(node_t n, uint32_t *bitmap) {
     return bitmap[n >> 5] & (1 << (n & 31));
 }
 
-typedef uint32_t(*bitmap_t)[N >> 5];
-static bool update_alloc_info(uint32_t dpu_id, node_t n, edge_ptr *m_count, bitmap_t bitmap) {
-    // check condition
+typedef uint32_t *bitmap_t;
+#define DPU_BITMAP(bitmap, dpu_id) ((bitmap) + (size_t)(dpu_id) * bitmap_words)
+
+void queue_init(uint32_t size);
+void push_to_queue(uint32_t dpu_id, double work_load);
+uint32_t pop_from_queue();
+uint32_t top_of_queue();
+extern uint32_t queue_size;
+
+typedef struct AllocArgs {
+    bitmap_t bitmap;   // bitmap of nodes put in dpu
+    node_t *allocate_rank;   // roots by descending workload
+    node_t cur;   // next root to plan
+    node_t end;   // roots placed through the heap
+    node_t max_deg[MAX_HOST_THREADS];
+    // part_num entries each
+    edge_ptr *m_count;   // edges put in dpu
+    double *dpu_workload;
+    uint32_t *rejected;   // dpus allocate_retry took out of the heap
+    // one root per dpu, evaluated concurrently
+    uint32_t batch_size;
+    uint32_t batch_next;
+    uint32_t *batch_dpu;
+    node_t *batch_root;
+    bool *batch_ok;
+    bool done;
+    bool overflow;   // a root found no part with room
+    pthread_barrier_t barrier;
+} AllocArgs;
+
+// edges the neighborhood of root adds to a part holding none of it
+static uint64_t root_need(node_t root) {
+    edge_ptr begin = global_g->row_ptr[root], end = global_g->row_ptr[root + 1];
+    uint64_t need = end - begin;
+    for (edge_ptr i = begin; i < end; i++) {
+        node_t neighbor = global_g->col_idx[i];
+        need += global_g->row_ptr[neighbor + 1] - global_g->row_ptr[neighbor];
+    }
+    return need;
+}
+
+// root found no part with room.  MULTI_PASS tries again with more epochs, which only helps
+// if the neighborhood of root fits in an empty part
+static void alloc_overflow(AllocArgs *args, node_t root) {
+#ifdef MULTI_PASS
+    if (root_need(root) <= DPU_M) {
+        args->overflow = true;
+        return;
+    }
+    printf(ANSI_COLOR_RED "Error: neighborhood of node %u does not fit in a DPU\n" ANSI_COLOR_RESET, root);
+#else
+    (void)args;
+    (void)root;
+    printf(ANSI_COLOR_RED "Error: not enough DPUs\n" ANSI_COLOR_RESET);
+#endif
+    exit(1);
+}
+
+// mark the neighborhood of root in the dpu bitmap while counting the edges it adds,
+// the newly marked nodes are kept in added and cleared again if the dpu overflows
+static bool update_alloc_info(AllocArgs *args, uint32_t dpu_id, node_t root, node_t *added) {
     if (global_g->root_num[dpu_id] == DPU_ROOT_NUM) {
         return false;
     }
-    edge_ptr dpu_m_count = m_count[dpu_id];
-    if (!check_in_bitmap(n, bitmap[dpu_id])) {
-        dpu_m_count += global_g->row_ptr[n + 1] - global_g->row_ptr[n];
+    uint32_t *dpu_bitmap = DPU_BITMAP(args->bitmap, dpu_id);
+    edge_ptr dpu_m_count = args->m_count[dpu_id];
+    node_t added_num = 0;
+    if (!check_in_bitmap(root, dpu_bitmap)) {
+        dpu_bitmap[root >> 5] |= (1 << (root & 31));
+        added[added_num++] = root;
+        dpu_m_count += global_g->row_ptr[root + 1] - global_g->row_ptr[root];
     }
-    for (edge_ptr i = global_g->row_ptr[n]; i < global_g->row_ptr[n + 1]; i++) {
+    for (edge_ptr i = global_g->row_ptr[root]; i < global_g->row_ptr[root + 1] && dpu_m_count <= DPU_M; i++) {
         node_t neighbor = global_g->col_idx[i];
-        if (!check_in_bitmap(neighbor, bitmap[dpu_id])) {
+        if (!check_in_bitmap(neighbor, dpu_bitmap)) {
+            dpu_bitmap[neighbor >> 5] |= (1 << (neighbor & 31));
+            added[added_num++] = neighbor;
             dpu_m_count += global_g->row_ptr[neighbor + 1] - global_g->row_ptr[neighbor];
         }
     }
     if (dpu_m_count > DPU_M) {
+        for (node_t i = 0; i < added_num; i++) {
+            dpu_bitmap[added[i] >> 5] &= ~(1 << (added[i] & 31));
+        }
         return false;
     }
 
-    // allocate
-    global_g->roots[dpu_id][global_g->root_num[dpu_id]++] = n;
-    m_count[dpu_id] = dpu_m_count;
-    bitmap[dpu_id][n >> 5] |= (1 << (n & 31));
-    for (edge_ptr i = global_g->row_ptr[n]; i < global_g->row_ptr[n + 1]; i++) {
-        node_t neighbor = global_g->col_idx[i];
-        bitmap[dpu_id][neighbor >> 5] |= (1 << (neighbor & 31));
-    }
+    global_g->roots[dpu_id][global_g->root_num[dpu_id]++] = root;
+    args->m_count[dpu_id] = dpu_m_count;
     return true;
 }
 
-void queue_init();
-void push_to_queue(uint32_t dpu_id, double work_load);
-uint32_t pop_from_queue();
+static void allocate_workload(uint32_t tid, uint32_t nr_threads, void *arg) {
+    AllocArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(global_g->n, tid, nr_threads, &begin, &end);
+    node_t max_deg = 0;
+    for (node_t i = begin; i < end; i++) {
+        args->allocate_rank[i] = i;
+        workload[i] = predict_workload(global_g, i);
+#ifdef PROFILE_MODEL
+        double profiled = profile_workload(global_g, i);
+        if (profiled > 0) workload[i] = profiled;
+#endif
+        max_deg = MAX(max_deg, global_g->row_ptr[i + 1] - global_g->row_ptr[i]);
+    }
+    args->max_deg[tid] = max_deg;
+}
 
-static void data_allocate(bitmap_t bitmap) {
-    static edge_ptr m_count[NR_DPUS];   // edges put in dpu
-    static node_t allocate_rank[N];
-    static double dpu_workload[NR_DPUS];
+// take the dpus the serial greedy would pick for the next roots, stopping before any dpu repeats,
+// so the batch can be evaluated concurrently with the same outcome
+static void allocate_plan(AllocArgs *args) {
+    double min_load = 0;
+    uint32_t min_dpu = 0;
+    args->batch_size = 0;
+    args->batch_next = 0;
+    if (args->overflow) {
+        args->done = true;
+        return;
+    }
+    while (args->cur < args->end && queue_size) {
+        uint32_t dpu_id = top_of_queue();
+        if (global_g->root_num[dpu_id] == DPU_ROOT_NUM) {
+            pop_from_queue();   // truly full
+            continue;
+        }
+        double load = args->dpu_workload[dpu_id];
+        if (args->batch_size && !(load < min_load || (load == min_load && dpu_id < min_dpu))) {
+            break;
+        }
+        pop_from_queue();
+        node_t root = args->allocate_rank[args->cur++];
+        args->batch_dpu[args->batch_size] = dpu_id;
+        args->batch_root[args->batch_size] = root;
+        args->batch_size++;
+        load += workload[root];
+        if (args->batch_size == 1 || load < min_load || (load == min_load && dpu_id < min_dpu)) {
+            min_load = load;
+            min_dpu = dpu_id;
+        }
+    }
+    if (args->batch_size == 0) {
+        if (args->cur < args->end) {
+            alloc_overflow(args, args->allocate_rank[args->cur]);
+        }
+        args->done = true;
+    }
+}
 
-    memset(bitmap, 0, (size_t)(N >> 3) * NR_DPUS);
-    for (uint32_t i = 0; i < NR_DPUS; i++) {
-        global_g->root_num[i] = 0;
-        global_g->roots[i] = malloc(DPU_ROOT_NUM * sizeof(node_t));
+// place a root its planned dpu rejected on the least loaded dpu that still has room.  dpus with
+// less room than the whole neighborhood of root are passed over without walking it, and only
+// tried, least loaded first, once every other dpu rejected root.  they stay in the heap either way
+static void allocate_retry(AllocArgs *args, node_t root, node_t *added) {
+    uint32_t *rejected = args->rejected;
+    uint32_t rejected_num = 0;
+    bool allocated = false;
+    if (args->overflow) {
+        return;
+    }
+    uint64_t need = root_need(root);
+    while (queue_size) {
+        uint32_t dpu_id = pop_from_queue();
+        if (global_g->root_num[dpu_id] == DPU_ROOT_NUM) {
+            continue;
+        }
+        if (DPU_M - args->m_count[dpu_id] >= need && update_alloc_info(args, dpu_id, root, added)) {
+            args->dpu_workload[dpu_id] += workload[root];
+            push_to_queue(dpu_id, args->dpu_workload[dpu_id]);
+            allocated = true;
+            break;
+        }
+        rejected[rejected_num++] = dpu_id;
     }
+    for (uint32_t i = 0; i < rejected_num && !allocated; i++) {
+        uint32_t dpu_id = rejected[i];
+        if (DPU_M - args->m_count[dpu_id] < need && update_alloc_info(args, dpu_id, root, added)) {
+            args->dpu_workload[dpu_id] += workload[root];
+            allocated = true;
+        }
+    }
+    if (!allocated) {
+        alloc_overflow(args, root);
+    }
+    for (uint32_t i = 0; i < rejected_num; i++) {
+        push_to_queue(rejected[i], args->dpu_workload[rejected[i]]);
+    }
+}
 
-    for (node_t i = 0; i < global_g->n; i++) {
-        allocate_rank[i] = i;
+static void allocate_commit(AllocArgs *args, node_t *added) {
+    for (uint32_t i = 0; i < args->batch_size; i++) {
+        uint32_t dpu_id = args->batch_dpu[i];
+        if (args->batch_ok[i]) {
+            args->dpu_workload[dpu_id] += workload[args->batch_root[i]];
+        }
+        push_to_queue(dpu_id, args->dpu_workload[dpu_id]);
     }
-    for (node_t i = 0; i < global_g->n; i++) {
-        workload[i] = predict_workload(global_g, i);
+    for (uint32_t i = 0; i < args->batch_size; i++) {
+        if (!args->batch_ok[i]) {
+            allocate_retry(args, args->batch_root[i], added);
+        }
+    }
+}
+
+static void allocate_worker(uint32_t tid, uint32_t nr_threads, void *arg) {
+    AllocArgs *args = arg;
+    (void)nr_threads;
+    node_t *added = malloc(((size_t)args->max_deg[0] + 1) * sizeof(node_t));
+    while (true) {
+        if (tid == 0) {
+            allocate_plan(args);
+        }
+        pthread_barrier_wait(&args->barrier);
+        if (args->done) {
+            break;
+        }
+        uint32_t i;
+        while ((i = __atomic_fetch_add(&args->batch_next, 1, __ATOMIC_RELAXED)) < args->batch_size) {
+            args->batch_ok[i] = update_alloc_info(args, args->batch_dpu[i], args->batch_root[i], added);
+        }
+        pthread_barrier_wait(&args->barrier);
+        if (tid == 0) {
+            allocate_commit(args, added);
+        }
     }
-    qsort(allocate_rank, global_g->n, sizeof(node_t), workload_cmp);
+    free(added);
+}
 
-    queue_init();
-    uint32_t full_dpu_ct = 0;
+#if defined(SPLIT_ROOTS) || defined(HYBRID_CPU)
+// neighbors a root iterates over at the second level
+static inline edge_ptr lower_degree(node_t root) {
+#if defined(ORIENTED) || (defined(GENERATED) && !GENERATED_LOWER_SECOND)
+    return global_g->row_ptr[root + 1] - global_g->row_ptr[root];
+#else
+    edge_ptr l = global_g->row_ptr[root], r = global_g->row_ptr[root + 1];
+    while (l < r) {
+        edge_ptr mid = (l + r) >> 1;
+        if (global_g->col_idx[mid] < root) {
+            l = mid + 1;
+        }
+        else {
+            r = mid;
+        }
+    }
+    return l - global_g->row_ptr[root];
+#endif
+}
+#endif
+
+#ifdef HYBRID_CPU
+// the dpu kernels keep a root's row in mram_buf and its lower neighbors in the bitmap
+static inline bool dpu_fit(node_t root) {
+    return global_g->row_ptr[root + 1] - global_g->row_ptr[root] <= MRAM_BUF_SIZE && lower_degree(root) <= BITMAP_SIZE * 32;
+}
+
+// the host threads take the heaviest roots up to their share of the modeled workload, leaving out
+// roots that would keep one thread busy past that share, plus every root the dpus cannot hold.
+// they are moved in front of cur and their workload is cleared, so the dpu allocation skips them.
+static void cpu_allocate(AllocArgs *args) {
+    node_t n = global_g->n;
+    double total = 0;
+    for (node_t i = 0; i < n; i++) {
+        total += workload[i];
+    }
+    double threads = host_thread_num() * HYBRID_THREAD_DPUS;
+    double budget = total * threads / (threads + nr_dpus / (double)global_g->epoch_num);
+    double cap = budget / host_thread_num();
+    double load = 0;
+    node_t *rest = malloc((size_t)n * sizeof(node_t));
+    node_t rest_num = 0, unfit_num = 0;
+    global_g->cpu_root_num = 0;
+    for (node_t i = 0; i < n; i++) {
+        node_t root = args->allocate_rank[i];
+        bool fit = dpu_fit(root);
+        if (!fit || (workload[root] <= cap && load + workload[root] <= budget)) {
+            args->allocate_rank[global_g->cpu_root_num++] = root;
+            load += workload[root];
+            workload[root] = 0;
+            unfit_num += !fit;
+        }
+        else {
+            rest[rest_num++] = root;
+        }
+    }
+    memcpy(args->allocate_rank + global_g->cpu_root_num, rest, (size_t)rest_num * sizeof(node_t));
+    free(rest);
+    global_g->cpu_roots = malloc(MAX(global_g->cpu_root_num, 1) * sizeof(node_t));
+    memcpy(global_g->cpu_roots, args->allocate_rank, global_g->cpu_root_num * sizeof(node_t));
+    args->cur = global_g->cpu_root_num;
+    printf("Host roots: %lu (%u too large for the dpus), workload share: %.3f\n", global_g->cpu_root_num, unfit_num, load / MAX(total, 1));
+}
+#endif
+
+#ifdef SPLIT_ROOTS
+// roots worth more than SPLIT_SHARE of a dpu's fair workload are cut into ranges of their lower
+// neighbors, balanced by the degree of those neighbors, and every range is placed on a different
+// dpu like a root of its own.  this runs before any other root, so split roots lead every root list.
+static void split_allocate(AllocArgs *args) {
+    uint32_t part_num = global_g->part_num;
+    uint32_t *taken = malloc(part_num * sizeof(uint32_t));
+    double total = 0;
     for (node_t i = 0; i < global_g->n; i++) {
-        while (full_dpu_ct != NR_DPUS) {
-            uint32_t cur_dpu = pop_from_queue();
-            if (update_alloc_info(cur_dpu, allocate_rank[i], m_count, bitmap)) {
-                dpu_workload[cur_dpu] += workload[allocate_rank[i]];
-                push_to_queue(cur_dpu, dpu_workload[cur_dpu]);
+        total += workload[i];
+    }
+    double piece = SPLIT_SHARE * total / part_num;
+    node_t *added = malloc(((size_t)args->max_deg[0] + 1) * sizeof(node_t));
+    node_t split_root_num = 0;
+    uint64_t split_total = 0;
+    for (; args->cur < global_g->n; args->cur++) {
+        node_t root = args->allocate_rank[args->cur];
+        edge_ptr row_begin = global_g->row_ptr[root];
+        edge_ptr lower = lower_degree(root);
+        double want = ceil(workload[root] / piece);
+        uint32_t parts = want < part_num ? (uint32_t)want : part_num;
+        parts = MIN(parts, lower);
+        if (workload[root] <= piece || parts < 2 || global_g->row_ptr[root + 1] - row_begin < BRANCH_LEVEL_THRESHOLD) {
+            break;
+        }
+
+        double weight = 0;
+        for (edge_ptr j = 0; j < lower; j++) {
+            node_t neighbor = global_g->col_idx[row_begin + j];
+            weight += global_g->row_ptr[neighbor + 1] - global_g->row_ptr[neighbor] + 1;
+        }
+        edge_ptr begin = 0;
+        double acc = 0;
+        uint32_t taken_num = 0;
+        for (uint32_t p = 0; p < parts; p++) {
+            // every later range keeps at least one neighbor
+            edge_ptr end = begin, limit = lower - (parts - 1 - p);
+            double acc_begin = acc;
+            double target = weight * (p + 1) / parts;
+            while (end < limit && (p == parts - 1 || end == begin || acc < target)) {
+                node_t neighbor = global_g->col_idx[row_begin + end++];
+                acc += global_g->row_ptr[neighbor + 1] - global_g->row_ptr[neighbor] + 1;
+            }
+
+            // least loaded dpu that does not hold a range of this root yet
+            bool allocated = false;
+            while (queue_size && !allocated) {
+                uint32_t dpu_id = pop_from_queue();
+                taken[taken_num++] = dpu_id;
+                if (global_g->root_num[dpu_id] == DPU_ROOT_NUM || global_g->split_num[dpu_id] == DPU_SPLIT_NUM) continue;
+                if (update_alloc_info(args, dpu_id, root, added)) {
+                    edge_ptr *range = &global_g->split_range[dpu_id][global_g->split_num[dpu_id]++ << 1];
+                    range[0] = begin;
+                    range[1] = end;
+                    args->dpu_workload[dpu_id] += workload[root] * (acc - acc_begin) / weight;
+                    allocated = true;
+                }
+            }
+            if (!allocated) {
+                alloc_overflow(args, root);
                 break;
             }
-            else {
-                full_dpu_ct++;
+            split_total++;
+            begin = end;
+        }
+        for (uint32_t i = 0; i < taken_num; i++) {
+            if (global_g->root_num[taken[i]] < DPU_ROOT_NUM) {
+                push_to_queue(taken[i], args->dpu_workload[taken[i]]);
             }
         }
-        if (full_dpu_ct == NR_DPUS) {
-            printf(ANSI_COLOR_RED "Error: not enough DPUs\n" ANSI_COLOR_RESET);
-            exit(1);
+        if (args->overflow) {
+            break;
         }
+        split_root_num++;
     }
+    if (split_root_num) {
+        printf("Split roots: %u into %lu ranges\n", split_root_num, split_total);
+    }
+    free(added);
+    free(taken);
 }
+#endif
 
-void data_compact(struct dpu_set_t set, bitmap_t bitmap) {
-    edge_ptr(*dpu_row_ptr)[DPU_N * 2];
-    dpu_row_ptr = malloc(NR_DPUS * DPU_N * 2 * sizeof(edge_ptr));
-    node_t(*dpu_col_idx)[DPU_M * 2];
-    dpu_col_idx = malloc(NR_DPUS * DPU_M * 2 * sizeof(node_t));
-    node_t(*dpu_roots)[DPU_ROOT_NUM];
-    dpu_roots = malloc(NR_DPUS * DPU_ROOT_NUM * sizeof(node_t));
+#ifdef LOCALITY_PARTITION
+typedef struct LocalityArgs {
+    AllocArgs *alloc;
+    node_t *label;
+    node_t *next_label;
+    uint32_t key_bits;
+    node_t *light;   // light roots grouped by label
+    node_t *seg_begin;   // light roots of each dpu, part_num + 1 entries
+    bool *failed;
+    uint32_t next_dpu;
+} LocalityArgs;
 
-    struct dpu_set_t dpu;
-    uint32_t each_dpu;
-    DPU_ASSERT(dpu_load(set, DPU_ALLOC_BINARY, NULL));
+// one synchronous label propagation step, every node takes the most frequent label among
+// itself and its neighbors, ties going to the smaller label
+static void locality_label(uint32_t tid, uint32_t nr_threads, void *arg) {
+    LocalityArgs *args = arg;
+    uint64_t begin, end;
+    parallel_range(global_g->n, tid, nr_threads, &begin, &end);
+    node_t max_deg = args->alloc->max_deg[0];
+    node_t *labels = malloc(((size_t)max_deg + 1) * sizeof(node_t));
+    node_t *tmp = malloc(((size_t)max_deg + 1) * sizeof(node_t));
+    for (node_t v = begin; v < end; v++) {
+        node_t size = 0;
+        labels[size++] = args->label[v];
+        for (edge_ptr i = global_g->row_ptr[v]; i < global_g->row_ptr[v + 1]; i++) {
+            labels[size++] = args->label[global_g->col_idx[i]];
+        }
+        sort_row(labels, size, tmp, args->key_bits);
+        node_t best = labels[0], best_count = 0;
+        for (node_t i = 0, j; i < size; i = j) {
+            for (j = i + 1; j < size && labels[j] == labels[i]; j++);
+            if (j - i > best_count) {
+                best = labels[i];
+                best_count = j - i;
+            }
+        }
+        args->next_label[v] = best;
+    }
+    free(labels);
+    free(tmp);
+}
 
-    uint64_t mode = 0;
-    DPU_ASSERT(dpu_broadcast_to(set, "mode", 0, &mode, sizeof(uint64_t), DPU_XFER_DEFAULT));
-    DPU_FOREACH(set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, bitmap[each_dpu]));
+// every dpu takes its contiguous run of light roots, the ones that do not fit are retried later
+static void locality_place(uint32_t tid, uint32_t nr_threads, void *arg) {
+    LocalityArgs *args = arg;
+    AllocArgs *alloc = args->alloc;
+    node_t *added = malloc(((size_t)alloc->max_deg[0] + 1) * sizeof(node_t));
+    uint32_t dpu_id;
+    (void)tid;
+    (void)nr_threads;
+    while ((dpu_id = __atomic_fetch_add(&args->next_dpu, 1, __ATOMIC_RELAXED)) < global_g->part_num) {
+        for (node_t i = args->seg_begin[dpu_id]; i < args->seg_begin[dpu_id + 1]; i++) {
+            node_t root = args->light[i];
+            if (update_alloc_info(alloc, dpu_id, root, added)) {
+                alloc->dpu_workload[dpu_id] += workload[root];
+            }
+            else {
+                args->failed[i] = true;
+            }
+        }
     }
-    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "bitmap", 0, (N >> 5) * sizeof(uint32_t), DPU_XFER_DEFAULT));
-    static uint32_t zero[N >> 5];
-    memset(zero, 0, sizeof(zero));
-    DPU_ASSERT(dpu_broadcast_to(set, "involve_bitmap", 0, zero, sizeof(zero), DPU_XFER_DEFAULT));
-    uint64_t start = 0;
-    while (start < global_g->n) {
-        uint64_t size = 0;
-        while (start + size < global_g->n && global_g->row_ptr[start + size + 1] - global_g->row_ptr[start] < PARTITION_M) {
-            size++;
+    free(added);
+}
+
+// roots above LOCALITY_HEAVY_SHARE of the average dpu workload are spread through the heap, the
+// rest are grouped by label propagation clusters and cut into one contiguous run per dpu, so
+// that roots sharing neighbors share the replicated adjacency.  a run stops before its dpu would
+// pass PARTITION_TOLERANCE above the common level, the roots left over go through the heap
+static void locality_allocate(AllocArgs *alloc) {
+    node_t n = global_g->n;
+    uint32_t part_num = global_g->part_num;
+    uint32_t nr_threads = host_thread_num();
+    double total = 0;
+    for (node_t i = 0; i < n; i++) {
+        total += workload[i];
+    }
+    double cap = LOCALITY_HEAVY_SHARE * total / part_num;
+    // roots before cur are placed already (split roots)
+    node_t first = alloc->cur;
+    uint8_t *placed = calloc(n, sizeof(uint8_t));
+    for (node_t i = 0; i < alloc->cur; i++) {
+        placed[alloc->allocate_rank[i]] = 1;
+    }
+    node_t heavy_num = alloc->cur;
+    for (node_t i = alloc->cur; i < n; i++) {
+        if (workload[alloc->allocate_rank[i]] > cap) {
+            alloc->allocate_rank[heavy_num++] = alloc->allocate_rank[i];
         }
-        DPU_ASSERT(dpu_broadcast_to(set, "start", 0, &start, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_broadcast_to(set, "size", 0, &size, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_broadcast_to(set, "row_ptr", 0, &global_g->row_ptr[start], ALIGN8((size + 1) * sizeof(edge_ptr)), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_broadcast_to(set, "col_idx", 0, &global_g->col_idx[global_g->row_ptr[start]], ALIGN8((global_g->row_ptr[start + size] - global_g->row_ptr[start]) * sizeof(node_t)), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_launch(set, DPU_SYNCHRONOUS));
-        start += size;
+    }
+    alloc->end = heavy_num;
+    pthread_barrier_init(&alloc->barrier, NULL, nr_threads);
+    parallel_run(allocate_worker, alloc);
+    pthread_barrier_destroy(&alloc->barrier);
+    if (alloc->overflow) {
+        free(placed);
+        return;
     }
 
-    mode = 1;
-    DPU_ASSERT(dpu_broadcast_to(set, "mode", 0, &mode, sizeof(uint64_t), DPU_XFER_DEFAULT));
-    uint64_t n_size = global_g->n;
-    DPU_ASSERT(dpu_broadcast_to(set, "size", 0, &n_size, sizeof(uint64_t), DPU_XFER_DEFAULT));
-    DPU_FOREACH(set, dpu, each_dpu) {
-        uint64_t root_num = global_g->root_num[each_dpu];
-        DPU_ASSERT(dpu_copy_to(dpu, "root_size", 0, &root_num, sizeof(uint64_t)));
+    static LocalityArgs args;
+    args.alloc = alloc;
+    args.label = malloc((size_t)n * sizeof(node_t));
+    args.next_label = malloc((size_t)n * sizeof(node_t));
+    args.key_bits = 0;
+    while (args.key_bits < 32 && (n - 1) >> args.key_bits) args.key_bits += ROW_RADIX_BITS;
+    for (node_t v = 0; v < n; v++) {
+        args.label[v] = v;
     }
-    DPU_FOREACH(set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, global_g->roots[each_dpu]));
+    for (uint32_t round = 0; round < LABEL_ROUNDS; round++) {
+        parallel_run(locality_label, &args);
+        node_t *swap = args.label;
+        args.label = args.next_label;
+        args.next_label = swap;
     }
-    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "roots", 0, DPU_ROOT_NUM * sizeof(node_t), DPU_XFER_DEFAULT));
-    DPU_ASSERT(dpu_launch(set, DPU_SYNCHRONOUS));
-    DPU_FOREACH(set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_roots[each_dpu]));
-    }
-    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_FROM_DPU, "roots", 0, DPU_ROOT_NUM * sizeof(node_t), DPU_XFER_DEFAULT));
-
-    mode = 2;
-    DPU_ASSERT(dpu_broadcast_to(set, "mode", 0, &mode, sizeof(uint64_t), DPU_XFER_DEFAULT));
-    static uint64_t processed_row_size[NR_DPUS];
-    memset(processed_row_size, 0, NR_DPUS * sizeof(uint64_t));
-    static uint64_t processed_col_size[NR_DPUS];
-    memset(processed_col_size, 0, NR_DPUS * sizeof(uint64_t));
-    static uint64_t tmp_row_size[NR_DPUS];
-    static uint64_t tmp_col_size[NR_DPUS];
-    start = 0;
-    while (start < global_g->n) {
-        uint64_t size = 0;
-        while (start + size < global_g->n && global_g->row_ptr[start + size + 1] - global_g->row_ptr[start] < PARTITION_M) {
-            size++;
+
+    // counting sort of the light roots by label, keeping id order inside a cluster.  the complement of the heavy
+    // test, so a root with a NaN workload is still placed
+    node_t *offset = args.next_label;
+    memset(offset, 0, (size_t)n * sizeof(node_t));
+    node_t light_num = 0;
+    for (node_t v = 0; v < n; v++) {
+        if (!(workload[v] > cap) && !placed[v]) {
+            offset[args.label[v]]++;
+            light_num++;
         }
-        DPU_ASSERT(dpu_broadcast_to(set, "start", 0, &start, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_broadcast_to(set, "size", 0, &size, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, &processed_col_size[each_dpu]));
+    }
+    node_t sum = 0;
+    for (node_t l = 0; l < n; l++) {
+        node_t count = offset[l];
+        offset[l] = sum;
+        sum += count;
+    }
+    args.light = alloc->allocate_rank + heavy_num;
+    double light_total = 0;
+    for (node_t v = 0; v < n; v++) {
+        if (!(workload[v] > cap) && !placed[v]) {
+            args.light[offset[args.label[v]]++] = v;
+            light_total += workload[v];
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "processed_offset", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_broadcast_to(set, "row_ptr", 0, &global_g->row_ptr[start], ALIGN8((size + 1) * sizeof(edge_ptr)), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_broadcast_to(set, "col_idx", 0, &global_g->col_idx[global_g->row_ptr[start]], ALIGN8((global_g->row_ptr[start + size] - global_g->row_ptr[start]) * sizeof(node_t)), DPU_XFER_DEFAULT));
-        DPU_ASSERT(dpu_launch(set, DPU_SYNCHRONOUS));
-        DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, &tmp_row_size[each_dpu]));
+    }
+
+    // fill the dpus up to the common level the light workload allows
+    double level = 0;
+    for (uint32_t i = 0; i < part_num; i++) {
+        level += alloc->dpu_workload[i];
+    }
+    level = (level + light_total) / part_num;
+    double bound = level * (1 + PARTITION_TOLERANCE);
+    node_t cur = 0;
+    args.seg_begin = malloc((part_num + 1) * sizeof(node_t));
+    for (uint32_t i = 0; i < part_num; i++) {
+        args.seg_begin[i] = cur;
+        double load = alloc->dpu_workload[i];
+        while (cur < light_num && load + workload[args.light[cur]] / 2 <= level && load + workload[args.light[cur]] <= bound) {
+            load += workload[args.light[cur++]];
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_FROM_DPU, "processed_row_size", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, &tmp_col_size[each_dpu]));
+    }
+    args.seg_begin[part_num] = cur;
+    args.failed = calloc(light_num, sizeof(bool));
+    for (node_t i = cur; i < light_num; i++) {
+        args.failed[i] = true;
+    }
+    args.next_dpu = 0;
+    parallel_run(locality_place, &args);
+
+    queue_size = 0;
+    for (uint32_t i = 0; i < part_num; i++) {
+        if (global_g->root_num[i] < DPU_ROOT_NUM) {
+            push_to_queue(i, alloc->dpu_workload[i]);
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_FROM_DPU, "processed_col_size", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
-        uint64_t max_row_size = 0;
-        uint64_t max_col_size = 0;
-        DPU_FOREACH(set, dpu, each_dpu) {
-            if (tmp_row_size[each_dpu] > max_row_size) {
-                max_row_size = tmp_row_size[each_dpu];
-            }
-            if (tmp_col_size[each_dpu] > max_col_size) {
-                max_col_size = tmp_col_size[each_dpu];
+    }
+    node_t *added = malloc(((size_t)alloc->max_deg[0] + 1) * sizeof(node_t));
+    for (node_t i = 0; i < light_num; i++) {
+        if (args.failed[i]) {
+            allocate_retry(alloc, args.light[i], added);
+        }
+    }
+    // split ranges lead the root lists, every other root must be in one exactly once
+    node_t placed_num = 0;
+    for (uint32_t i = 0; i < part_num && !alloc->overflow; i++) {
+        placed_num += global_g->root_num[i] - global_g->split_num[i];
+    }
+    if (!alloc->overflow && placed_num != n - first) {
+        printf(ANSI_COLOR_RED "Error: %u of %u roots were not placed\n" ANSI_COLOR_RESET, n - first - placed_num, n - first);
+        exit(1);
+    }
+    free(added);
+    free(placed);
+    free(args.seg_begin);
+    free(args.failed);
+    free(args.label);
+    free(args.next_label);
+}
+#endif
+
+// fresh root lists for every part, then split roots, heavy roots and light roots from cur on,
+// false if they do not all fit
+static bool allocate_parts(AllocArgs *args) {
+    uint32_t part_num = global_g->part_num;
+    args->done = false;
+    args->overflow = false;
+    free(args->bitmap);
+    free(args->m_count);
+    free(args->dpu_workload);
+    free(args->rejected);
+    free(args->batch_dpu);
+    free(args->batch_root);
+    free(args->batch_ok);
+    args->bitmap = calloc((size_t)bitmap_words * part_num, sizeof(uint32_t));
+    args->m_count = calloc(part_num, sizeof(edge_ptr));
+    args->dpu_workload = calloc(part_num, sizeof(double));
+    args->rejected = malloc(part_num * sizeof(uint32_t));
+    args->batch_dpu = malloc(part_num * sizeof(uint32_t));
+    args->batch_root = malloc(part_num * sizeof(node_t));
+    args->batch_ok = malloc(part_num * sizeof(bool));
+    for (uint32_t i = 0; i < part_num; i++) {
+        global_g->root_num[i] = 0;
+        global_g->spare_num[i] = 0;
+        global_g->split_num[i] = 0;
+        global_g->roots[i] = malloc(DPU_ROOT_NUM * sizeof(node_t));
+        global_g->split_range[i] = malloc(DPU_SPLIT_NUM * 2 * sizeof(edge_ptr));
+    }
+
+    queue_init(part_num);
+#ifdef SPLIT_ROOTS
+    split_allocate(args);
+    if (args->overflow) {
+        return false;
+    }
+#endif
+#ifdef LOCALITY_PARTITION
+    locality_allocate(args);
+#else
+    args->end = global_g->n;
+    pthread_barrier_init(&args->barrier, NULL, host_thread_num());
+    parallel_run(allocate_worker, args);
+    pthread_barrier_destroy(&args->barrier);
+#endif
+    return !args->overflow;
+}
+
+static bitmap_t data_allocate() {
+    static AllocArgs args;
+    uint32_t nr_threads = host_thread_num();
+    args.allocate_rank = malloc((size_t)global_g->n * sizeof(node_t));
+    args.cur = 0;
+    workload = malloc((size_t)global_g->n * sizeof(double));
+#ifdef PROFILE_MODEL
+    check_profile();
+#endif
+
+    parallel_run(allocate_workload, &args);
+    for (uint32_t t = 1; t < nr_threads; t++) {
+        args.max_deg[0] = MAX(args.max_deg[0], args.max_deg[t]);
+    }
+    qsort(args.allocate_rank, global_g->n, sizeof(node_t), workload_cmp);
+
+#ifdef HYBRID_CPU
+    cpu_allocate(&args);
+#endif
+#ifdef MULTI_PASS
+    // locality_allocate reorders the roots after first, every attempt starts from the sorted order
+    node_t first = args.cur;
+    node_t *sorted = malloc((size_t)global_g->n * sizeof(node_t));
+    memcpy(sorted, args.allocate_rank, (size_t)global_g->n * sizeof(node_t));
+    while (!allocate_parts(&args)) {
+        uint32_t epoch_num = MAX(global_g->epoch_num + 1, (uint32_t)(global_g->epoch_num * EPOCH_GROWTH));
+        printf("Roots do not fit in %u epochs, retrying with %u\n", global_g->epoch_num, epoch_num);
+        graph_parts(global_g, epoch_num);
+        memcpy(args.allocate_rank, sorted, (size_t)global_g->n * sizeof(node_t));
+        args.cur = first;
+    }
+    free(sorted);
+    if (global_g->epoch_num > 1) {
+        printf("Epochs: %u\n", global_g->epoch_num);
+    }
+#else
+    allocate_parts(&args);
+#endif
+    uint64_t replicated = 0;
+    double max_workload = 0, total_workload = 0;
+    for (uint32_t i = 0; i < global_g->part_num; i++) {
+        replicated += args.m_count[i];
+        max_workload = MAX(max_workload, args.dpu_workload[i]);
+        total_workload += args.dpu_workload[i];
+    }
+    printf("Replication factor: %.3f, workload imbalance: %.3f\n", (double)replicated / MAX(global_g->m, 1),
+           max_workload * global_g->part_num / MAX(total_workload, 1));
+    bitmap_t bitmap = args.bitmap;
+    args.bitmap = NULL;
+    free(args.allocate_rank);
+    free(args.m_count);
+    free(args.dpu_workload);
+    free(args.rejected);
+    free(args.batch_dpu);
+    free(args.batch_root);
+    free(args.batch_ok);
+    args.m_count = NULL;
+    args.dpu_workload = NULL;
+    args.rejected = NULL;
+    args.batch_dpu = NULL;
+    args.batch_root = NULL;
+    args.batch_ok = NULL;
+    free(workload);
+#ifdef PROFILE_MODEL
+    free(profile.data);
+    profile.data = NULL;
+#endif
+#ifdef DEGENERACY_ORDER
+    free(core_num);
+#endif
+    return bitmap;
+}
+
+#ifdef DYNAMIC_SCHEDULE
+typedef struct SpareArgs {
+    bitmap_t bitmap;
+    uint32_t *home;   // dpu owning every root, nr_dpus for split and host roots which stay where they are
+    uint32_t next_dpu;
+} SpareArgs;
+
+// a root of another dpu can run here as well when its whole neighborhood is in the dpu bitmap,
+// such roots are kept after the own ones so idle dpus can take them over at run time
+static void spare_collect(uint32_t tid, uint32_t nr_threads, void *arg) {
+    SpareArgs *args = arg;
+    uint32_t dpu_id;
+    (void)tid;
+    (void)nr_threads;
+    while ((dpu_id = __atomic_fetch_add(&args->next_dpu, 1, __ATOMIC_RELAXED)) < nr_dpus) {
+        uint32_t *dpu_bitmap = DPU_BITMAP(args->bitmap, dpu_id);
+        node_t *spares = global_g->roots[dpu_id] + global_g->root_num[dpu_id];
+        uint64_t spare_num = 0, spare_cap = DPU_ROOT_NUM - global_g->root_num[dpu_id];
+        for (size_t w = 0; w < bitmap_words && spare_num < spare_cap; w++) {
+            for (uint32_t bits = dpu_bitmap[w]; bits && spare_num < spare_cap; bits &= bits - 1) {
+                node_t node = (w << 5) | __builtin_ctz(bits);
+                if (args->home[node] == dpu_id || args->home[node] == nr_dpus) continue;
+                edge_ptr i = global_g->row_ptr[node];
+                while (i < global_g->row_ptr[node + 1] && check_in_bitmap(global_g->col_idx[i], dpu_bitmap)) i++;
+                if (i == global_g->row_ptr[node + 1]) {
+                    spares[spare_num++] = node;
+                }
             }
         }
-        if (max_row_size != 0) {
-            DPU_FOREACH(set, dpu, each_dpu) {
-                DPU_ASSERT(dpu_prepare_xfer(dpu, &dpu_row_ptr[each_dpu][processed_row_size[each_dpu]]));
+        global_g->spare_num[dpu_id] = spare_num;
+    }
+}
+
+static void data_spare(bitmap_t bitmap) {
+    static SpareArgs args;
+    args.bitmap = bitmap;
+    args.home = malloc((size_t)global_g->n * sizeof(uint32_t));
+    for (uint32_t i = 0; i < nr_dpus; i++) {
+        for (uint64_t j = 0; j < global_g->root_num[i]; j++) {
+            args.home[global_g->roots[i][j]] = j < global_g->split_num[i] ? nr_dpus : i;
+        }
+    }
+    for (uint64_t j = 0; j < global_g->cpu_root_num; j++) {
+        args.home[global_g->cpu_roots[j]] = nr_dpus;
+    }
+    args.next_dpu = 0;
+    parallel_run(spare_collect, &args);
+    uint64_t spare_total = 0;
+    for (uint32_t i = 0; i < nr_dpus; i++) {
+        spare_total += global_g->spare_num[i];
+    }
+    printf("Spare roots: %.3f per root\n", (double)spare_total / MAX(global_g->n, 1));
+    free(args.home);
+}
+
+// the scheduler pushes roots by their dpu ids, which only the images know
+static void keep_local_roots(DpuImage *images) {
+    for (uint32_t i = 0; images && i < nr_dpus; i++) {
+        uint64_t size = (global_g->root_num[i] + global_g->spare_num[i]) * sizeof(node_t);
+        global_g->local_roots[i] = malloc(MAX(size, 1));
+        memcpy(global_g->local_roots[i], images[i].roots, size);
+    }
+}
+#endif
+
+// every field of the part_num images lives in one block with a fixed per-dpu stride,
+// so a transfer of the largest image never reads past a smaller one
+DpuImage *alloc_images(uint64_t row_stride, uint64_t col_stride, uint64_t root_stride) {
+    uint32_t part_num = global_g->part_num;
+    DpuImage *images = calloc(part_num, sizeof(DpuImage));
+    edge_ptr *row_ptr = malloc(part_num * ALIGN2(row_stride) * sizeof(edge_ptr));
+    node_t *col_idx = malloc(part_num * ALIGN2(col_stride) * sizeof(node_t));
+    node_t *roots = malloc(part_num * ALIGN2(root_stride) * sizeof(node_t));
+    for (uint32_t i = 0; i < part_num; i++) {
+        images[i].row_ptr = row_ptr + i * ALIGN2(row_stride);
+        images[i].col_idx = col_idx + i * ALIGN2(col_stride);
+        images[i].roots = roots + i * ALIGN2(root_stride);
+    }
+    return images;
+}
+
+void free_images(DpuImage *images) {
+    if (!images) return;
+    free(images[0].row_ptr);
+    free(images[0].col_idx);
+    free(images[0].roots);
+    free(images);
+}
+
+#ifdef HOST_COMPACT
+typedef struct CompactArgs {
+    bitmap_t bitmap;
+    DpuImage *images;
+    uint32_t next_dpu;
+    uint64_t *row_size;   // part_num entries each
+    uint64_t *col_size;
+} CompactArgs;
+
+// nodes of the dpu bitmap plus their neighbors, returns the number of edges they own
+static uint64_t build_involve(const uint32_t *dpu_bitmap, uint32_t *involve) {
+    uint64_t col_size = 0;
+    memcpy(involve, dpu_bitmap, bitmap_words * sizeof(uint32_t));
+    for (size_t w = 0; w < bitmap_words; w++) {
+        for (uint32_t bits = dpu_bitmap[w]; bits; bits &= bits - 1) {
+            node_t node = (w << 5) | __builtin_ctz(bits);
+            for (edge_ptr i = global_g->row_ptr[node]; i < global_g->row_ptr[node + 1]; i++) {
+                node_t neighbor = global_g->col_idx[i];
+                involve[neighbor >> 5] |= (1 << (neighbor & 31));
             }
-            DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_FROM_DPU, "processed_row_ptr", 0, ALIGN8(max_row_size * sizeof(edge_ptr)), DPU_XFER_DEFAULT));
+            col_size += global_g->row_ptr[node + 1] - global_g->row_ptr[node];
+        }
+    }
+    return col_size;
+}
+
+static inline node_t compact_renumber(const uint32_t *involve, const node_t *prefix, node_t node) {
+    return prefix[node >> 5] + __builtin_popcount(involve[node >> 5] & ((1u << (node & 31)) - 1));
+}
+
+static void compact_size(uint32_t tid, uint32_t nr_threads, void *arg) {
+    CompactArgs *args = arg;
+    uint32_t *involve = malloc(bitmap_words * sizeof(uint32_t));
+    uint32_t dpu_id;
+    (void)tid;
+    (void)nr_threads;
+    while ((dpu_id = __atomic_fetch_add(&args->next_dpu, 1, __ATOMIC_RELAXED)) < global_g->part_num) {
+        args->col_size[dpu_id] = build_involve(DPU_BITMAP(args->bitmap, dpu_id), involve);
+        uint64_t row_size = 0;
+        for (size_t w = 0; w < bitmap_words; w++) {
+            row_size += __builtin_popcount(involve[w]);
         }
-        if (max_col_size != 0) {
-            DPU_FOREACH(set, dpu, each_dpu) {
-                DPU_ASSERT(dpu_prepare_xfer(dpu, &dpu_col_idx[each_dpu][processed_col_size[each_dpu]]));
+        args->row_size[dpu_id] = row_size;
+    }
+    free(involve);
+}
+
+// same layout as the DPU_ALLOC_BINARY path: a row for every involved node in global order,
+// only the nodes of the dpu bitmap keep their edges
+static void compact_fill(uint32_t tid, uint32_t nr_threads, void *arg) {
+    CompactArgs *args = arg;
+    uint32_t *involve = malloc(bitmap_words * sizeof(uint32_t));
+    node_t *prefix = malloc(bitmap_words * sizeof(node_t));
+    uint32_t dpu_id;
+    (void)tid;
+    (void)nr_threads;
+    while ((dpu_id = __atomic_fetch_add(&args->next_dpu, 1, __ATOMIC_RELAXED)) < global_g->part_num) {
+        const uint32_t *dpu_bitmap = DPU_BITMAP(args->bitmap, dpu_id);
+        DpuImage *image = &args->images[dpu_id];
+        build_involve(dpu_bitmap, involve);
+        node_t sum = 0;
+        for (size_t w = 0; w < bitmap_words; w++) {
+            prefix[w] = sum;
+            sum += __builtin_popcount(involve[w]);
+        }
+        edge_ptr row_size = 0, col_size = 0;
+        for (size_t w = 0; w < bitmap_words; w++) {
+            for (uint32_t bits = involve[w]; bits; bits &= bits - 1) {
+                uint32_t bit = __builtin_ctz(bits);
+                node_t node = (w << 5) | bit;
+                image->row_ptr[row_size++] = col_size;
+                if (dpu_bitmap[w] & (1u << bit)) {
+                    for (edge_ptr i = global_g->row_ptr[node]; i < global_g->row_ptr[node + 1]; i++) {
+                        image->col_idx[col_size++] = compact_renumber(involve, prefix, global_g->col_idx[i]);
+                    }
+                }
             }
-            DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_FROM_DPU, "processed_col_idx", 0, ALIGN8(max_col_size * sizeof(node_t)), DPU_XFER_DEFAULT));
         }
-        DPU_FOREACH(set, dpu, each_dpu) {
-            processed_row_size[each_dpu] += tmp_row_size[each_dpu];
-            processed_col_size[each_dpu] += tmp_col_size[each_dpu];
+        image->row_ptr[row_size] = col_size;
+        image->row_size = row_size;
+        image->col_size = col_size;
+        for (uint64_t i = 0; i < global_g->root_num[dpu_id] + global_g->spare_num[dpu_id]; i++) {
+            image->roots[i] = compact_renumber(involve, prefix, global_g->roots[dpu_id][i]);
         }
+    }
+    free(involve);
+    free(prefix);
+}
+
+// build the compacted per-dpu images on the host threads, one dpu at a time per thread
+static DpuImage *data_compact_host(bitmap_t bitmap) {
+    static CompactArgs args;
+    args.bitmap = bitmap;
+    args.next_dpu = 0;
+    args.row_size = malloc(global_g->part_num * sizeof(uint64_t));
+    args.col_size = malloc(global_g->part_num * sizeof(uint64_t));
+    parallel_run(compact_size, &args);
+    uint64_t max_row_size = 0;
+    uint64_t max_col_size = 0;
+    for (uint32_t i = 0; i < global_g->part_num; i++) {
+        max_row_size = MAX(max_row_size, args.row_size[i]);
+        max_col_size = MAX(max_col_size, args.col_size[i]);
+    }
+    free(args.row_size);
+    free(args.col_size);
+    if (max_row_size > DPU_N - 1 || max_col_size > DPU_M) {
+        printf(ANSI_COLOR_RED "Error: DPU image too large\n" ANSI_COLOR_RESET);
+        exit(1);
+    }
+    args.images = alloc_images(max_row_size + 1, max_col_size, DPU_ROOT_NUM);
+    args.next_dpu = 0;
+    parallel_run(compact_fill, &args);
+    return args.images;
+}
+#else
+typedef struct CompactChunks {
+    uint64_t num;
+    uint64_t *start;
+    uint64_t *size;
+} CompactChunks;
+
+// chunks of consecutive rows with fewer than PARTITION_M rows and edges, the same for mode 0 and mode 2
+static void compact_chunks(CompactChunks *chunks) {
+    uint64_t capacity = 16;
+    chunks->num = 0;
+    chunks->start = malloc(capacity * sizeof(uint64_t));
+    chunks->size = malloc(capacity * sizeof(uint64_t));
+    uint64_t start = 0;
+    while (start < global_g->n) {
+        uint64_t size = 0;
+        while (start + size < global_g->n && size + 2 <= PARTITION_M && global_g->row_ptr[start + size + 1] - global_g->row_ptr[start] < PARTITION_M) {
+            size++;
+        }
+        if (size == 0) {
+            printf(ANSI_COLOR_RED "Error: node %lu too large for DPU compaction\n" ANSI_COLOR_RESET, start);
+            exit(1);
+        }
+        if (chunks->num == capacity) {
+            capacity <<= 1;
+            chunks->start = realloc(chunks->start, capacity * sizeof(uint64_t));
+            chunks->size = realloc(chunks->size, capacity * sizeof(uint64_t));
+        }
+        chunks->start[chunks->num] = start;
+        chunks->size[chunks->num] = size;
+        chunks->num++;
         start += size;
     }
-    for (uint32_t i = 0; i < NR_DPUS; i++) {
-        dpu_row_ptr[i][processed_row_size[i]] = processed_col_size[i];
+}
+
+// queue the chunk behind the previous launch, a rank takes it as soon as it is done with that one
+static void compact_push_chunk(struct dpu_set_t set, CompactChunks *chunks, uint64_t k) {
+    uint64_t start = chunks->start[k];
+    uint64_t size = chunks->size[k];
+    DPU_ASSERT(dpu_broadcast_to(set, "start", 0, &chunks->start[k], sizeof(uint64_t), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_broadcast_to(set, "size", 0, &chunks->size[k], sizeof(uint64_t), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_broadcast_to(set, "row_ptr", 0, &global_g->row_ptr[start], ALIGN8((size + 1) * sizeof(edge_ptr)), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_broadcast_to(set, "col_idx", 0, &global_g->col_idx[global_g->row_ptr[start]], ALIGN8((global_g->row_ptr[start + size] - global_g->row_ptr[start]) * sizeof(node_t)), DPU_XFER_ASYNC));
+}
+
+typedef struct CompactGather {
+    DpuImage *images;
+    uint32_t *rank_offset;   // index of the first dpu of each rank
+    // nr_dpus entries each
+    uint64_t *processed_col_size;
+    uint64_t *tmp_row_size;
+    uint64_t *tmp_col_size;
+} CompactGather;
+
+// runs on each rank right after its mode 2 launch, so ranks gather while others still compute
+static dpu_error_t compact_gather(struct dpu_set_t rank, uint32_t rank_id, void *arg) {
+    CompactGather *args = arg;
+    DpuImage *images = args->images;
+    uint32_t first = args->rank_offset[rank_id];
+    struct dpu_set_t dpu;
+    uint32_t each_dpu;
+    DPU_FOREACH(rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &args->tmp_row_size[first + each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(rank, DPU_XFER_FROM_DPU, "processed_row_size", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
+    DPU_FOREACH(rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &args->tmp_col_size[first + each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(rank, DPU_XFER_FROM_DPU, "processed_col_size", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
+    uint64_t max_row_size = 0;
+    uint64_t max_col_size = 0;
+    DPU_FOREACH(rank, dpu, each_dpu) {
+        max_row_size = MAX(max_row_size, args->tmp_row_size[first + each_dpu]);
+        max_col_size = MAX(max_col_size, args->tmp_col_size[first + each_dpu]);
     }
+    if (max_row_size != 0) {
+        DPU_FOREACH(rank, dpu, each_dpu) {
+            DpuImage *image = &images[first + each_dpu];
+            DPU_ASSERT(dpu_prepare_xfer(dpu, &image->row_ptr[image->row_size]));
+        }
+        DPU_ASSERT(dpu_push_xfer(rank, DPU_XFER_FROM_DPU, "processed_row_ptr", 0, ALIGN8(max_row_size * sizeof(edge_ptr)), DPU_XFER_DEFAULT));
+    }
+    if (max_col_size != 0) {
+        DPU_FOREACH(rank, dpu, each_dpu) {
+            DPU_ASSERT(dpu_prepare_xfer(dpu, &images[first + each_dpu].col_idx[args->processed_col_size[first + each_dpu]]));
+        }
+        DPU_ASSERT(dpu_push_xfer(rank, DPU_XFER_FROM_DPU, "processed_col_idx", 0, ALIGN8(max_col_size * sizeof(node_t)), DPU_XFER_DEFAULT));
+    }
+    DPU_FOREACH(rank, dpu, each_dpu) {
+        images[first + each_dpu].row_size += args->tmp_row_size[first + each_dpu];
+        args->processed_col_size[first + each_dpu] += args->tmp_col_size[first + each_dpu];
+    }
+    return DPU_OK;
+}
 
-    DPU_ASSERT(dpu_load(set, DPU_BINARY, NULL));
+// build the compacted per-dpu images with the help of DPU_ALLOC_BINARY, every step is queued
+// asynchronously so each rank runs through the chunks at its own pace
+static DpuImage *data_compact(struct dpu_set_t set, bitmap_t bitmap) {
+    static const uint64_t modes[3] = {0, 1, 2};
+    static const uint64_t zero_offset = 0;
+    static CompactGather args;
+    uint64_t *root_size = malloc(nr_dpus * sizeof(uint64_t));   // own and spare roots
+    // twice the mram size since gathering transfers the largest chunk for every dpu
+    DpuImage *images = alloc_images(DPU_N * 2, DPU_M * 2, DPU_ROOT_NUM);
+    args.images = images;
+    args.processed_col_size = calloc(nr_dpus, sizeof(uint64_t));
+    args.tmp_row_size = malloc(nr_dpus * sizeof(uint64_t));
+    args.tmp_col_size = malloc(nr_dpus * sizeof(uint64_t));
+
+    struct dpu_set_t dpu, rank;
+    uint32_t each_dpu, each_rank;
+    if (global_g->n > PARTITION_N) {
+        printf(ANSI_COLOR_RED "Error: graph too large for DPU compaction\n" ANSI_COLOR_RESET);
+        exit(1);
+    }
+    uint32_t nr_ranks;
+    DPU_ASSERT(dpu_get_nr_ranks(set, &nr_ranks));
+    args.rank_offset = malloc(nr_ranks * sizeof(uint32_t));
+    uint32_t rank_offset = 0;
+    DPU_RANK_FOREACH(set, rank, each_rank) {
+        uint32_t rank_dpus;
+        DPU_ASSERT(dpu_get_nr_dpus(rank, &rank_dpus));
+        args.rank_offset[each_rank] = rank_offset;
+        rank_offset += rank_dpus;
+    }
+    CompactChunks chunks;
+    compact_chunks(&chunks);
+    DPU_ASSERT(dpu_load(set, DPU_ALLOC_BINARY, NULL));
+
+    DPU_ASSERT(dpu_broadcast_to(set, "mode", 0, &modes[0], sizeof(uint64_t), DPU_XFER_ASYNC));
     DPU_FOREACH(set, dpu, each_dpu) {
-        uint64_t root_num = global_g->root_num[each_dpu];
-        DPU_ASSERT(dpu_copy_to(dpu, "root_num", 0, &root_num, sizeof(uint64_t)));
+        DPU_ASSERT(dpu_prepare_xfer(dpu, DPU_BITMAP(bitmap, each_dpu)));
+    }
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "bitmap", 0, bitmap_words * sizeof(uint32_t), DPU_XFER_ASYNC));
+    uint32_t *zero = calloc(bitmap_words, sizeof(uint32_t));
+    DPU_ASSERT(dpu_broadcast_to(set, "involve_bitmap", 0, zero, bitmap_words * sizeof(uint32_t), DPU_XFER_ASYNC));
+    for (uint64_t k = 0; k < chunks.num; k++) {
+        compact_push_chunk(set, &chunks, k);
+        DPU_ASSERT(dpu_launch(set, DPU_ASYNCHRONOUS));
     }
+
+    uint64_t n_size = global_g->n;
+    DPU_ASSERT(dpu_broadcast_to(set, "mode", 0, &modes[1], sizeof(uint64_t), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_broadcast_to(set, "size", 0, &n_size, sizeof(uint64_t), DPU_XFER_ASYNC));
     DPU_FOREACH(set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_roots[each_dpu]));
+        root_size[each_dpu] = global_g->root_num[each_dpu] + global_g->spare_num[each_dpu];
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &root_size[each_dpu]));
     }
-    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "roots", 0, DPU_ROOT_NUM * sizeof(node_t), DPU_XFER_DEFAULT));
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "root_size", 0, sizeof(uint64_t), DPU_XFER_ASYNC));
     DPU_FOREACH(set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_row_ptr[each_dpu]));
+        DPU_ASSERT(dpu_prepare_xfer(dpu, global_g->roots[each_dpu]));
     }
-    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "row_ptr", 0, DPU_N * sizeof(edge_ptr), DPU_XFER_DEFAULT));
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "roots", 0, DPU_ROOT_NUM * sizeof(node_t), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_launch(set, DPU_ASYNCHRONOUS));
     DPU_FOREACH(set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_col_idx[each_dpu]));
+        DPU_ASSERT(dpu_prepare_xfer(dpu, images[each_dpu].roots));
     }
-    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "col_idx", 0, DPU_M * sizeof(node_t), DPU_XFER_DEFAULT));
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_FROM_DPU, "roots", 0, DPU_ROOT_NUM * sizeof(node_t), DPU_XFER_ASYNC));
 
-    free(dpu_row_ptr);
-    free(dpu_col_idx);
-    free(dpu_roots);
-}
+    // the dpus keep their own output offset from here on
+    DPU_ASSERT(dpu_broadcast_to(set, "mode", 0, &modes[2], sizeof(uint64_t), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_broadcast_to(set, "processed_offset", 0, &zero_offset, sizeof(uint64_t), DPU_XFER_ASYNC));
+    for (uint64_t k = 0; k < chunks.num; k++) {
+        compact_push_chunk(set, &chunks, k);
+        DPU_ASSERT(dpu_launch(set, DPU_ASYNCHRONOUS));
+        DPU_ASSERT(dpu_callback(set, compact_gather, &args, DPU_CALLBACK_ASYNC));
+    }
+    DPU_ASSERT(dpu_sync(set));
 
-void data_transfer(struct dpu_set_t set, Graph *g) {
-    global_g = g;
-    read_input();
-    data_renumber();
-    bitmap_t bitmap;   // bitmap of nodes put in dpu
-    bitmap = malloc((size_t)(N >> 3) * NR_DPUS);
-    data_allocate(bitmap);
-#ifdef NO_PARTITION_AS_POSSIBLE
-    if (global_g->n > DPU_N - 1 || global_g->m > DPU_M) {
-#endif
-        data_compact(set, bitmap);
-#ifdef NO_PARTITION_AS_POSSIBLE
+    for (uint32_t i = 0; i < nr_dpus; i++) {
+        images[i].col_size = args.processed_col_size[i];
+        images[i].row_ptr[images[i].row_size] = images[i].col_size;
     }
-    else {
-        struct dpu_set_t dpu;
-        uint32_t each_dpu;
+    free(zero);
+    free(root_size);
+    free(args.processed_col_size);
+    free(args.tmp_row_size);
+    free(args.tmp_col_size);
+    free(chunks.start);
+    free(chunks.size);
+    free(args.rank_offset);
+    return images;
+}
+#endif
 
-        DPU_ASSERT(dpu_load(set, DPU_BINARY, NULL));
-        node_t max_root_num = 0;
-        DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, &global_g->root_num[each_dpu]));
-            if(global_g->root_num[each_dpu] > max_root_num) {
-                max_root_num = global_g->root_num[each_dpu];
-            }
+// root lists of the parts of one epoch and, when compacted, their images
+static void push_epoch(struct dpu_set_t set, DpuImage *images, uint32_t epoch, dpu_xfer_flags_t flags) {
+    struct dpu_set_t dpu;
+    uint32_t each_dpu;
+    uint32_t first = epoch * nr_dpus;
+
+    uint64_t max_root_num = 0;
+    uint64_t max_row_size = 0;
+    uint64_t max_col_size = 0;
+    DPU_FOREACH(set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &global_g->root_num[first + each_dpu]));
+        max_root_num = MAX(max_root_num, global_g->root_num[first + each_dpu]);
+        if (images) {
+            max_row_size = MAX(max_row_size, images[first + each_dpu].row_size);
+            max_col_size = MAX(max_col_size, images[first + each_dpu].col_size);
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "root_num", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
+    }
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "root_num", 0, sizeof(uint64_t), flags));
+    DPU_FOREACH(set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, images ? images[first + each_dpu].roots : global_g->roots[first + each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "roots", 0, ALIGN8(max_root_num * sizeof(node_t)), flags));
+#ifdef SPLIT_ROOTS
+    uint64_t max_split_num = 0;
+    DPU_FOREACH(set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &global_g->split_num[first + each_dpu]));
+        max_split_num = MAX(max_split_num, global_g->split_num[first + each_dpu]);
+    }
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "split_num", 0, sizeof(uint64_t), flags));
+    if (max_split_num) {
         DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, global_g->roots[each_dpu]));
+            DPU_ASSERT(dpu_prepare_xfer(dpu, global_g->split_range[first + each_dpu]));
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "roots", 0, ALIGN8(max_root_num * sizeof(node_t)), DPU_XFER_DEFAULT));
+        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "split_range", 0, max_split_num * 2 * sizeof(edge_ptr), flags));
+    }
+#endif
+    if (!images) {
+        return;
+    }
+    DPU_FOREACH(set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, images[first + each_dpu].row_ptr));
+    }
+    DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "row_ptr", 0, ALIGN8((max_row_size + 1) * sizeof(edge_ptr)), flags));
+    if (max_col_size) {
         DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, global_g->row_ptr));
+            DPU_ASSERT(dpu_prepare_xfer(dpu, images[first + each_dpu].col_idx));
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "row_ptr", 0, ALIGN8((global_g->n + 1) * sizeof(edge_ptr)), DPU_XFER_DEFAULT));
-        DPU_FOREACH(set, dpu, each_dpu) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, global_g->col_idx));
+        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "col_idx", 0, ALIGN8(max_col_size * sizeof(node_t)), flags));
+    }
+}
+
+// load DPU_BINARY and push the first epoch, without images every epoch shares the whole graph
+static void push_graph(struct dpu_set_t set, DpuImage *images) {
+    DPU_ASSERT(dpu_load(set, DPU_BINARY, NULL));
+    push_epoch(set, images, 0, DPU_XFER_DEFAULT);
+    if (!images) {
+        DPU_ASSERT(dpu_broadcast_to(set, "row_ptr", 0, global_g->row_ptr, ALIGN8((global_g->n + 1) * sizeof(edge_ptr)), DPU_XFER_DEFAULT));
+        if (global_g->m) {
+            DPU_ASSERT(dpu_broadcast_to(set, "col_idx", 0, global_g->col_idx, ALIGN8(global_g->m * sizeof(node_t)), DPU_XFER_DEFAULT));
+        }
+    }
+}
+
+#ifdef MULTI_PASS
+static DpuImage *epoch_images;   // images of every epoch, kept for the next query when there are several
+
+// queued behind the current work of every rank, so a rank takes the epoch as soon as it is idle
+void epoch_push(struct dpu_set_t set, uint32_t epoch) {
+    push_epoch(set, epoch_images, epoch, DPU_XFER_ASYNC);
+}
+
+void epoch_free() {
+    free_images(epoch_images);
+    epoch_images = NULL;
+}
+#endif
+
+// the images are dropped once pushed, unless later epochs need them again
+static void release_images(DpuImage *images) {
+#ifdef MULTI_PASS
+    if (global_g->epoch_num > 1) {
+        epoch_images = images;
+        return;
+    }
+#endif
+    free_images(images);
+}
+
+// (re)size the per-part arrays of g for epoch_num epochs of nr_dpus root lists, freeing the old ones
+void graph_parts(Graph *g, uint32_t epoch_num) {
+    for (uint32_t i = 0; g->root_num && i < g->part_num; i++) {
+        free(g->roots[i]);
+        free(g->local_roots[i]);
+        free(g->split_range[i]);
+    }
+    free(g->root_num);
+    free(g->spare_num);
+    free(g->split_num);
+    free(g->roots);
+    free(g->local_roots);
+    free(g->split_range);
+    g->epoch_num = epoch_num;
+    g->part_num = nr_dpus * epoch_num;
+    g->root_num = calloc(g->part_num, sizeof(uint64_t));
+    g->spare_num = calloc(g->part_num, sizeof(uint64_t));
+    g->split_num = calloc(g->part_num, sizeof(uint64_t));
+    g->roots = calloc(g->part_num, sizeof(node_t *));
+    g->local_roots = calloc(g->part_num, sizeof(node_t *));
+    g->split_range = calloc(g->part_num, sizeof(edge_ptr *));
+}
+
+#ifdef MULTI_PASS
+// no part takes more than DPU_ROOT_NUM roots or DPU_M edges, so fewer epochs cannot fit
+static uint32_t epoch_estimate() {
+    uint64_t root_epochs = (global_g->n + (uint64_t)nr_dpus * DPU_ROOT_NUM - 1) / ((uint64_t)nr_dpus * DPU_ROOT_NUM);
+    uint64_t edge_epochs = (global_g->m + (uint64_t)nr_dpus * DPU_M - 1) / ((uint64_t)nr_dpus * DPU_M);
+    return MAX(MAX(root_epochs, edge_epochs), 1);
+}
+#endif
+
+void data_transfer(struct dpu_set_t set, Graph *g, const char *path) {
+    global_g = g;
+    g->part_num = 0;
+    g->root_num = g->spare_num = g->split_num = NULL;
+    g->roots = g->local_roots = NULL;
+    g->split_range = NULL;
+    g->cpu_root_num = 0;
+    g->cpu_roots = NULL;
+    MappedGraph src;
+    read_input(path, &src);
+    DpuImage *images = NULL;
+#ifdef PREPROCESS_CACHE
+    char cache_file[512];
+    cache_path(path, cache_file, sizeof(cache_file));
+#ifdef PROFILE_MODEL
+    load_profile(path);
+    uint64_t key = cache_key(src.addr, src.size, profile.data, profile.data ? 3 * (size_t)profile.n * sizeof(uint64_t) : 0);
+#else
+    uint64_t key = cache_key(src.addr, src.size, NULL, 0);
+#endif
+    if (cache_load(cache_file, key, global_g, &images)) {
+        printf("Preprocessed graph loaded from %s\n", cache_file);
+        if (global_g->epoch_num > 1) {
+            printf("Epochs: %u\n", global_g->epoch_num);
         }
-        DPU_ASSERT(dpu_push_xfer(set, DPU_XFER_TO_DPU, "col_idx", 0, ALIGN8(global_g->m * sizeof(node_t)), DPU_XFER_DEFAULT));
+#ifdef PROFILE_MODEL
+        free(profile.data);
+        profile.data = NULL;
+#endif
+        munmap(src.addr, src.size);
+        push_graph(set, images);
+#ifdef DYNAMIC_SCHEDULE
+        keep_local_roots(images);
+#endif
+        release_images(images);
+        return;
+    }
+#elif defined(PROFILE_MODEL)
+    load_profile(path);
+#endif
+    data_renumber(&src);
+    bitmap_words = BITMAP_WORDS(global_g->n);
+#ifdef MULTI_PASS
+    graph_parts(global_g, epoch_estimate());
+#else
+    graph_parts(global_g, 1);
+#endif
+    bitmap_t bitmap = data_allocate();   // bitmap of nodes put in each part
+#ifdef NO_PARTITION_AS_POSSIBLE
+    if (global_g->n > DPU_N - 1 || global_g->m > DPU_M) {
+#endif
+#ifdef DYNAMIC_SCHEDULE
+        data_spare(bitmap);
+#endif
+#ifdef HOST_COMPACT
+        images = data_compact_host(bitmap);
+#else
+        images = data_compact(set, bitmap);
+#endif
+#ifdef NO_PARTITION_AS_POSSIBLE
     }
 #endif
     free(bitmap);
-}
\ No newline at end of file
+    push_graph(set, images);
+#ifdef PREPROCESS_CACHE
+    cache_store(cache_file, key, global_g, images);
+#endif
+#ifdef DYNAMIC_SCHEDULE
+    keep_local_roots(images);
+#endif
+    release_images(images);
+}
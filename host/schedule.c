@@ -0,0 +1,293 @@
+#define _DEFAULT_SOURCE
+#include <common.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <dpu.h>
+
+#ifdef DYNAMIC_SCHEDULE
+// roots go out in waves: every wave a dpu takes SCHEDULE_SHARE of its remaining own roots, heaviest
+// first, and once those are gone it takes over roots other dpus have not started yet, as long as
+// their neighborhood is resident.  mram can only be accessed while the whole rank is stopped,
+// so a rank is refilled as soon as all of its dpus are done.
+typedef struct RankWave {
+    struct dpu_set_t rank;
+    uint32_t first;   // index of the first dpu of the rank
+    uint32_t nr_dpus;
+    uint64_t stride;   // per-dpu entries of the buffers below
+    node_t *roots;   // global ids
+    node_t *local_roots;   // dpu ids
+    edge_ptr *split_range;   // ranges of the split roots leading each wave
+    ans_t *ans;
+    uint64_t *cycle;
+    bool running;
+} RankWave;
+
+typedef struct Schedule {
+    Graph *g;
+    uint8_t *claimed;   // root handed out already
+    uint64_t unclaimed;
+    // nr_dpus entries each
+    uint64_t *head;   // own roots before head are handed out
+    uint64_t *tail;   // and, with the whole graph on every dpu, the ones from tail on
+    uint64_t *spare_cur;
+    uint64_t *wave_num;
+    uint64_t *wave_split_num;   // split roots lead the wave
+    uint64_t waves;
+    uint64_t taken_over;
+} Schedule;
+
+static inline uint64_t own_chunk(Schedule *s, uint32_t dpu_id) {
+    uint64_t remaining = s->tail[dpu_id] - s->head[dpu_id];
+    return MIN(remaining, MAX((uint64_t)SCHEDULE_MIN_ROOTS, (uint64_t)(remaining * SCHEDULE_SHARE)));
+}
+
+static inline uint64_t steal_chunk(Schedule *s) {
+    return MIN(s->unclaimed, MAX((uint64_t)SCHEDULE_MIN_ROOTS, (uint64_t)(s->unclaimed * SCHEDULE_SHARE / nr_dpus)));
+}
+
+static inline uint64_t stealable(Schedule *s, uint32_t dpu_id) {
+    uint64_t begin = MAX(s->head[dpu_id], s->g->split_num[dpu_id]);
+    return s->tail[dpu_id] > begin ? s->tail[dpu_id] - begin : 0;
+}
+
+static inline bool claim(Schedule *s, node_t root) {
+    if (s->claimed[root]) return false;
+    s->claimed[root] = 1;
+    s->unclaimed--;
+    return true;
+}
+
+// fill the wave of one dpu, returns its size
+static uint64_t pick_wave(Schedule *s, uint32_t dpu_id, node_t *roots, node_t *local_roots, edge_ptr *split_range) {
+    Graph *g = s->g;
+    uint64_t num = 0;
+    if (s->head[dpu_id] < s->tail[dpu_id]) {
+        uint64_t chunk = own_chunk(s, dpu_id);
+        while (num < chunk && s->head[dpu_id] < s->tail[dpu_id]) {
+            uint64_t k = s->head[dpu_id]++;
+            node_t root = g->roots[dpu_id][k];
+            if (k < g->split_num[dpu_id]) {
+                split_range[num << 1] = g->split_range[dpu_id][k << 1];
+                split_range[num << 1 | 1] = g->split_range[dpu_id][k << 1 | 1];
+                s->wave_split_num[dpu_id]++;
+            }
+            else if (!claim(s, root)) {
+                continue;
+            }
+            roots[num] = root;
+            local_roots[num] = g->local_roots[dpu_id] ? g->local_roots[dpu_id][k] : root;
+            num++;
+        }
+        return num;
+    }
+
+    uint64_t chunk = steal_chunk(s);
+    if (g->local_roots[dpu_id]) {
+        // only the spares of this dpu have their neighborhood here
+        while (num < chunk && s->spare_cur[dpu_id] < g->spare_num[dpu_id]) {
+            uint64_t k = g->root_num[dpu_id] + s->spare_cur[dpu_id]++;
+            node_t root = g->roots[dpu_id][k];
+            if (!claim(s, root)) continue;
+            roots[num] = root;
+            local_roots[num] = g->local_roots[dpu_id][k];
+            num++;
+        }
+    }
+    else {
+        // every dpu holds the whole graph, take the lightest roots of the dpu with the most left,
+        // the ranges of split roots stay where they are.  the dpus are only scanned again once
+        // the victim runs dry, not for every root
+        while (num < chunk) {
+            uint32_t victim = 0;
+            for (uint32_t i = 1; i < nr_dpus; i++) {
+                if (stealable(s, i) > stealable(s, victim)) victim = i;
+            }
+            if (!stealable(s, victim)) break;
+            while (num < chunk && stealable(s, victim)) {
+                node_t root = g->roots[victim][--s->tail[victim]];
+                if (!claim(s, root)) continue;
+                roots[num] = root;
+                local_roots[num] = root;
+                num++;
+            }
+        }
+    }
+    s->taken_over += num;
+    return num;
+}
+
+// hand the next wave to every dpu of the rank and launch it, false when nothing is left for it
+static bool dispatch_wave(Schedule *s, RankWave *w) {
+    struct dpu_set_t dpu;
+    uint32_t each_dpu;
+    w->stride = 0;
+    for (uint32_t i = 0; i < w->nr_dpus; i++) {
+        uint32_t dpu_id = w->first + i;
+        uint64_t bound = s->head[dpu_id] < s->tail[dpu_id] ? own_chunk(s, dpu_id) : steal_chunk(s);
+        w->stride = MAX(w->stride, bound);
+    }
+    if (w->stride == 0) return false;
+    w->stride = ALIGN2(w->stride);
+    w->roots = malloc(w->nr_dpus * w->stride * sizeof(node_t));
+    w->local_roots = malloc(w->nr_dpus * w->stride * sizeof(node_t));
+    w->ans = malloc(w->nr_dpus * w->stride * sizeof(ans_t));
+    w->cycle = malloc(w->nr_dpus * w->stride * sizeof(uint64_t));
+    w->split_range = malloc(w->nr_dpus * w->stride * 2 * sizeof(edge_ptr));
+    uint64_t max_num = 0, max_split_num = 0;
+    for (uint32_t i = 0; i < w->nr_dpus; i++) {
+        uint32_t dpu_id = w->first + i;
+        s->wave_split_num[dpu_id] = 0;
+        s->wave_num[dpu_id] = pick_wave(s, dpu_id, w->roots + i * w->stride, w->local_roots + i * w->stride, w->split_range + i * w->stride * 2);
+        max_num = MAX(max_num, s->wave_num[dpu_id]);
+        max_split_num = MAX(max_split_num, s->wave_split_num[dpu_id]);
+    }
+    if (max_num == 0) {
+        free(w->roots);
+        free(w->local_roots);
+        free(w->ans);
+        free(w->cycle);
+        free(w->split_range);
+        return false;
+    }
+
+    DPU_FOREACH(w->rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &s->wave_num[w->first + each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(w->rank, DPU_XFER_TO_DPU, "root_num", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
+    DPU_FOREACH(w->rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, w->local_roots + each_dpu * w->stride));
+    }
+    DPU_ASSERT(dpu_push_xfer(w->rank, DPU_XFER_TO_DPU, "roots", 0, ALIGN8(max_num * sizeof(node_t)), DPU_XFER_DEFAULT));
+#ifdef SPLIT_ROOTS
+    DPU_FOREACH(w->rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &s->wave_split_num[w->first + each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(w->rank, DPU_XFER_TO_DPU, "split_num", 0, sizeof(uint64_t), DPU_XFER_DEFAULT));
+    if (max_split_num) {
+        DPU_FOREACH(w->rank, dpu, each_dpu) {
+            DPU_ASSERT(dpu_prepare_xfer(dpu, w->split_range + each_dpu * w->stride * 2));
+        }
+        DPU_ASSERT(dpu_push_xfer(w->rank, DPU_XFER_TO_DPU, "split_range", 0, max_split_num * 2 * sizeof(edge_ptr), DPU_XFER_DEFAULT));
+    }
+#endif
+    DPU_ASSERT(dpu_launch(w->rank, DPU_ASYNCHRONOUS));
+    s->waves++;
+    return true;
+}
+
+static void collect_wave(Schedule *s, RankWave *w, ans_t *result, uint64_t *cycle_ct, uint32_t *executed_on) {
+    struct dpu_set_t dpu;
+    uint32_t each_dpu;
+    uint64_t max_num = 0;
+    for (uint32_t i = 0; i < w->nr_dpus; i++) {
+        max_num = MAX(max_num, s->wave_num[w->first + i]);
+    }
+    DPU_FOREACH(w->rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, w->ans + each_dpu * w->stride));
+    }
+    DPU_ASSERT(dpu_push_xfer(w->rank, DPU_XFER_FROM_DPU, "ans", 0, ALIGN8(max_num * sizeof(ans_t)), DPU_XFER_DEFAULT));
+#ifdef PERF
+    DPU_FOREACH(w->rank, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, w->cycle + each_dpu * w->stride));
+    }
+    DPU_ASSERT(dpu_push_xfer(w->rank, DPU_XFER_FROM_DPU, "cycle_ct", 0, ALIGN8(max_num * sizeof(uint64_t)), DPU_XFER_DEFAULT));
+#endif
+    for (uint32_t i = 0; i < w->nr_dpus; i++) {
+        for (uint64_t k = 0; k < s->wave_num[w->first + i]; k++) {
+            node_t root = w->roots[i * w->stride + k];
+            // the ranges of a split root add up
+            result[root] += w->ans[i * w->stride + k];
+#ifdef PERF
+            cycle_ct[root] += w->cycle[i * w->stride + k];
+#endif
+            executed_on[root] = w->first + i;
+        }
+    }
+    (void)cycle_ct;
+    free(w->roots);
+    free(w->local_roots);
+    free(w->ans);
+    free(w->cycle);
+    free(w->split_range);
+}
+
+// run every root on the dpus, refilling each rank as soon as it is done, false if a dpu faults
+bool data_schedule(struct dpu_set_t set, Graph *g, ans_t *result, uint64_t *cycle_ct, uint32_t *executed_on) {
+    static Schedule s;
+    s.g = g;
+    s.claimed = calloc(g->n, sizeof(uint8_t));
+    s.unclaimed = g->n;
+    s.waves = 0;
+    s.taken_over = 0;
+    s.head = malloc(nr_dpus * sizeof(uint64_t));
+    s.tail = malloc(nr_dpus * sizeof(uint64_t));
+    s.spare_cur = malloc(nr_dpus * sizeof(uint64_t));
+    s.wave_num = calloc(nr_dpus, sizeof(uint64_t));
+    s.wave_split_num = calloc(nr_dpus, sizeof(uint64_t));
+    for (uint32_t i = 0; i < nr_dpus; i++) {
+        s.head[i] = 0;
+        s.tail[i] = g->root_num[i];
+        s.spare_cur[i] = 0;
+        for (uint64_t k = 0; k < g->split_num[i]; k++) {
+            claim(&s, g->roots[i][k]);
+        }
+    }
+    // HYBRID_CPU roots are run by the host threads
+    for (uint64_t k = 0; k < g->cpu_root_num; k++) {
+        claim(&s, g->cpu_roots[k]);
+    }
+
+    struct dpu_set_t rank;
+    uint32_t each_rank, nr_ranks;
+    DPU_ASSERT(dpu_get_nr_ranks(set, &nr_ranks));
+    RankWave *waves = calloc(nr_ranks, sizeof(RankWave));
+    uint32_t first = 0, running = 0;
+    DPU_RANK_FOREACH(set, rank, each_rank) {
+        waves[each_rank].rank = rank;
+        waves[each_rank].first = first;
+        DPU_ASSERT(dpu_get_nr_dpus(rank, &waves[each_rank].nr_dpus));
+        first += waves[each_rank].nr_dpus;
+    }
+    for (uint32_t i = 0; i < nr_ranks; i++) {
+        waves[i].running = dispatch_wave(&s, &waves[i]);
+        running += waves[i].running;
+    }
+
+    bool fine = true;
+    while (running) {
+        bool progress = false;
+        for (uint32_t i = 0; i < nr_ranks; i++) {
+            if (!waves[i].running) continue;
+            bool done, fault;
+            DPU_ASSERT(dpu_status(waves[i].rank, &done, &fault));
+            if (fault) {
+                printf("Rank: %u failed\n", i);
+                fine = false;
+                done = true;
+            }
+            if (!done) continue;
+            progress = true;
+            collect_wave(&s, &waves[i], result, cycle_ct, executed_on);
+            waves[i].running = fine && dispatch_wave(&s, &waves[i]);
+            running -= !waves[i].running;
+        }
+        if (!progress) usleep(SCHEDULE_POLL_US);
+    }
+    if (fine && s.unclaimed) {
+        printf(ANSI_COLOR_RED "Error: %lu roots left unscheduled\n" ANSI_COLOR_RESET, s.unclaimed);
+        fine = false;
+    }
+    printf("Waves: %lu, roots taken over: %lu\n", s.waves, s.taken_over);
+    free(waves);
+    free(s.claimed);
+    free(s.head);
+    free(s.tail);
+    free(s.spare_cur);
+    free(s.wave_num);
+    free(s.wave_split_num);
+    return fine;
+}
+#endif
@@ -0,0 +1,114 @@
+#define _DEFAULT_SOURCE
+#include <common.h>
+#include <server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// line protocol, one request per line:
+//   <pattern>   ->  "ok <pattern> <count> <latency_us>"
+//   shutdown    ->  "ok shutdown", the server exits after closing the connection
+// anything else is answered with "error <reason>".  clients are served one at a time, the
+// others wait in the listen backlog, since every query uses all dpus.
+extern const char *const pattern_names[NR_PATTERNS];
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static double now_us() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static void serve_client(int client, uint32_t supported, query_func_t query) {
+    FILE *in = fdopen(dup(client), "r");
+    if (!in) return;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while (!stopping && (len = getline(&line, &cap, in)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ')) line[--len] = '\0';
+        if (len == 0) continue;
+        if (!strcmp(line, "shutdown")) {
+            dprintf(client, "ok shutdown\n");
+            stopping = 1;
+            break;
+        }
+        uint32_t pattern = 0;
+        while (pattern < NR_PATTERNS && strcmp(pattern_names[pattern], line)) pattern++;
+        if (pattern == NR_PATTERNS) {
+            dprintf(client, "error unknown pattern %s\n", line);
+            continue;
+        }
+        if (!(supported >> pattern & 1)) {
+            dprintf(client, "error %s is not built into this binary\n", line);
+            continue;
+        }
+        ans_t total = 0;
+        double begin = now_us();
+        bool fine = query(pattern, &total);
+        double latency = now_us() - begin;
+        printf("Query %s: %lu in %.0f us\n", line, total, latency);
+        fflush(stdout);
+        if (fine) dprintf(client, "ok %s %lu %.0f\n", line, total, latency);
+        else dprintf(client, "error %s failed\n", line);
+    }
+    free(line);
+    fclose(in);
+}
+
+void serve(const char *socket_path, uint32_t supported, query_func_t query) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf(ANSI_COLOR_RED "Error: socket path %s too long\n" ANSI_COLOR_RESET, socket_path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);  // left over by a server that was killed
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SERVER_BACKLOG)) {
+        printf(ANSI_COLOR_RED "Error: cannot listen on %s: %s\n" ANSI_COLOR_RESET, socket_path, strerror(errno));
+        exit(1);
+    }
+
+    // no SA_RESTART, so a signal breaks accept() and getline()
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);  // a client that hangs up early only fails its own writes
+
+    printf("Serving on %s\n", socket_path);
+    fflush(stdout);
+    stopping = 0;
+    while (!stopping) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            printf(ANSI_COLOR_RED "Error: accept failed: %s\n" ANSI_COLOR_RESET, strerror(errno));
+            break;
+        }
+        serve_client(client, supported, query);
+        close(client);
+    }
+    close(fd);
+    unlink(socket_path);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    printf("Server stopped\n");
+}
@@ -1,10 +1,51 @@
 #include <common.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
-node_t intersect(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c) {
+// sorted sets without duplicates.  the vector paths compare a block of a with every rotation of a
+// block of b and drop the block with the smaller maximum, very uneven sizes gallop through the larger set
+
+// first position in a[0, size) not below x
+static inline node_t lower_bound(const node_t *a, node_t size, node_t x) {
+    node_t l = 0, r = size;
+    while (l < r) {
+        node_t mid = l + ((r - l) >> 1);
+        if (a[mid] < x) {
+            l = mid + 1;
+        }
+        else {
+            r = mid;
+        }
+    }
+    return l;
+}
+
+// a is the smaller set, every element is searched from the last match on with growing steps
+static node_t intersect_gallop(const node_t *a, node_t a_size, const node_t *b, node_t b_size, node_t *c) {
+    node_t j = 0, k = 0;
+    for (node_t i = 0; i < a_size && j < b_size; i++) {
+        node_t step = 1;
+        while (j + step < b_size && b[j + step] < a[i]) {
+            j += step;
+            step <<= 1;
+        }
+        j += lower_bound(b + j, MIN(step + 1, b_size - j), a[i]);
+        if (j < b_size && b[j] == a[i]) {
+            if (c) c[k] = a[i];
+            k++;
+            j++;
+        }
+    }
+    return k;
+}
+
+static node_t intersect_merge(const node_t *a, node_t a_size, const node_t *b, node_t b_size, node_t *c) {
     node_t i = 0, j = 0, k = 0;
     while (i < a_size && j < b_size) {
         if (a[i] == b[j]) {
-            c[k++] = a[i];
+            if (c) c[k] = a[i];
+            k++;
             i++;
             j++;
         }
@@ -18,6 +59,91 @@ node_t intersect(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c)
     return k;
 }
 
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+// 8 lanes, 16 lose more to the scalar tail of short adjacency lists than they gain on long ones
+static node_t intersect_vector(const node_t *a, node_t a_size, const node_t *b, node_t b_size, node_t *c) {
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    node_t i = 0, j = 0, k = 0;
+    while (i + 8 <= a_size && j + 8 <= b_size) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+        __mmask8 mask = _mm256_cmpeq_epi32_mask(va, vb);
+        for (int r = 1; r < 8; r++) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            mask |= _mm256_cmpeq_epi32_mask(va, vb);
+        }
+        if (c) _mm256_mask_compressstoreu_epi32(c + k, mask, va);
+        k += __builtin_popcount(mask);
+        node_t a_max = a[i + 7], b_max = b[j + 7];
+        if (a_max <= b_max) i += 8;
+        if (b_max <= a_max) j += 8;
+    }
+    return k + intersect_merge(a + i, a_size - i, b + j, b_size - j, c ? c + k : NULL);
+}
+#elif defined(__AVX2__)
+static uint32_t compress_table[256][8];  // lanes of every 8-bit mask moved to the front
+
+__attribute__((constructor)) static void compress_init() {
+    for (uint32_t mask = 0; mask < 256; mask++) {
+        uint32_t k = 0;
+        for (uint32_t lane = 0; lane < 8; lane++) {
+            if (mask >> lane & 1) compress_table[mask][k++] = lane;
+        }
+    }
+}
+
+static node_t intersect_vector(const node_t *a, node_t a_size, const node_t *b, node_t b_size, node_t *c) {
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    node_t i = 0, j = 0, k = 0;
+    while (i + 8 <= a_size && j + 8 <= b_size) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+        __m256i match = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; r++) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            match = _mm256_or_si256(match, _mm256_cmpeq_epi32(va, vb));
+        }
+        uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+        if (c) {
+            // writes all 8 lanes, SET_OP_SLACK covers the ones past the result
+            __m256i order = _mm256_loadu_si256((const __m256i *)compress_table[mask]);
+            _mm256_storeu_si256((__m256i *)(c + k), _mm256_permutevar8x32_epi32(va, order));
+        }
+        k += __builtin_popcount(mask);
+        node_t a_max = a[i + 7], b_max = b[j + 7];
+        if (a_max <= b_max) i += 8;
+        if (b_max <= a_max) j += 8;
+    }
+    return k + intersect_merge(a + i, a_size - i, b + j, b_size - j, c ? c + k : NULL);
+}
+#else
+#define intersect_vector intersect_merge
+#endif
+
+// c may be NULL to only count, otherwise it needs SET_OP_SLACK entries past the result
+static inline node_t intersect_any(const node_t *a, node_t a_size, const node_t *b, node_t b_size, node_t *c) {
+    if ((uint64_t)a_size * GALLOP_RATIO < b_size) return intersect_gallop(a, a_size, b, b_size, c);
+    if ((uint64_t)b_size * GALLOP_RATIO < a_size) return intersect_gallop(b, b_size, a, a_size, c);
+    return intersect_vector(a, a_size, b, b_size, c);
+}
+
+node_t intersect(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c) {
+    return intersect_any(a, a_size, b, b_size, c);
+}
+
+node_t intersect_count(node_t *a, node_t a_size, node_t *b, node_t b_size) {
+    return intersect_any(a, a_size, b, b_size, NULL);
+}
+
+// common elements below bound
+node_t intersect_below(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t bound, node_t *c) {
+    return intersect_any(a, lower_bound(a, a_size, bound), b, lower_bound(b, b_size, bound), c);
+}
+
+node_t intersect_count_below(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t bound) {
+    return intersect_any(a, lower_bound(a, a_size, bound), b, lower_bound(b, b_size, bound), NULL);
+}
+
 node_t difference(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c) {
     node_t i = 0, j = 0, k = 0;
     while (i < a_size && j < b_size) {
@@ -38,4 +164,4 @@ node_t difference(node_t *a, node_t a_size, node_t *b, node_t b_size, node_t *c)
         i++;
     }
     return k;
-}
\ No newline at end of file
+}
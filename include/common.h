@@ -8,56 +8,65 @@
 // #define DPU_LOG
 // #define CPU_RUN
 #define NO_PARTITION_AS_POSSIBLE
+#define LOCALITY_PARTITION  // co-locate roots with overlapping neighborhoods
+// #define DYNAMIC_SCHEDULE  // hand out roots in waves, idle ranks take over roots resident on them
+// #define HYBRID_CPU  // host threads mine a share of the roots while the dpus run
+// #define TOTAL_ONLY  // tasklets reduce to one count per dpu, no per-root answers are gathered
+// #define MULTI_PASS  // roots that do not fit the mram of all dpus run in epochs, each with its own images
+#define HOST_COMPACT  // build per-dpu images on the host instead of with DPU_ALLOC_BINARY
+#define PREPROCESS_CACHE
 // #define MORE_ACCURATE_MODEL
-#if defined(CLIQUE4) || defined(CLIQUE5)
+// #define PROFILE_MODEL  // estimate workload from the cycle counts of a previous PERF run
+#if defined(CLIQUE4) || defined(CLIQUE5) || defined(ALL_PATTERNS)
 #define BITMAP
 #endif
+#define ORIENTATION
+#if defined(ORIENTATION) && (defined(CLIQUE2) || defined(CLIQUE3) || defined(CLIQUE4) || defined(CLIQUE5))
+#define ORIENTED  // only lower ranked neighbors are kept
+#endif
+#define SPLIT_HEAVY
+#if defined(SPLIT_HEAVY) && !defined(CLIQUE2)
+#define SPLIT_ROOTS  // heavy roots are cut into ranges of lower neighbors on several dpus
+#endif
+#define DEGENERACY
+#if defined(DEGENERACY) && (defined(CLIQUE2) || defined(CLIQUE3) || defined(CLIQUE4) || defined(CLIQUE5) || defined(TRI_TRI6))
+#define DEGENERACY_ORDER  // renumber by k-core peeling order instead of degree
+#endif
+#if defined(ALL_PATTERNS) && defined(PROFILE_MODEL)
+#error "PROFILE_MODEL needs a single PATTERN"
+#endif
+#if defined(TOTAL_ONLY) && defined(DYNAMIC_SCHEDULE)
+#error "DYNAMIC_SCHEDULE gathers per-root answers, it cannot be used with TOTAL_ONLY"
+#endif
+#if defined(MULTI_PASS) && (defined(DYNAMIC_SCHEDULE) || !defined(HOST_COMPACT))
+#error "MULTI_PASS needs HOST_COMPACT and cannot be used with DYNAMIC_SCHEDULE"
+#endif
 
 #define DATA_DIR "./data/"
-#if defined(SELF)
-#define DATA_NAME "self-defined"
-#define N (1<<5)
-#define M (1<<5)
-#elif defined(WV)
-#define DATA_NAME "Wiki-Vote"
-#define N (1<<13)
-#define M (1<<18)
-#elif defined(PP)
-#define DATA_NAME "p2p-Gnutella04"
-#define N (1<<14)
-#define M (1<<17)
-#elif defined(CA)
-#define DATA_NAME "CA-AstroPh"
-#define N (1<<15)
-#define M (1<<19)
-#elif defined(YT)
-#define DATA_NAME "com-youtube"
-#define N (1<<21)
-#define M (1<<23)
-#elif defined(PT)
-#define DATA_NAME "cit-Patents"
-#define N (1<<22)
-#define M (1<<26)
-#elif defined(LJ)
-#define DATA_NAME "soc-LiveJournall"
-#define N (1<<23)
-#define M (1<<27)
-#else
-#warning "No graph selected, fall back to PP."
-#define DATA_NAME "p2p-Gnutella04"
-#define N (1<<14)
-#define M (1<<17)
+#define CACHE_DIR "./cache/"
+#define RESULT_DIR "./result/"
+#ifndef DEFAULT_DATA_PATH
+#define DEFAULT_DATA_PATH DATA_DIR "p2p-Gnutella04.bin"
+#endif
+#ifndef DEFAULT_PATTERNS
+#define DEFAULT_PATTERNS "clique3,clique4,cycle4,house5,tri_tri6"
 #endif
-#define DATA_PATH DATA_DIR DATA_NAME ".bin"
 
 #ifndef NR_DPUS
 #warning "No NR_DPUS defined, fall back to 1."
-#define NR_DPUS 1
+#define NR_DPUS 1  // default dpu count of the host, -d picks another one at runtime
+#endif
+#ifndef DPU_PROFILE
+#define DPU_PROFILE "backend=simulator"  // default dpu_alloc profile, -p picks another one at runtime
 #endif
 #ifndef NR_TASKLETS
 #warning "No NR_TASKLETS defined, fall back to 1."
 #define NR_TASKLETS 1
 #endif
+#ifndef NR_HOST_THREADS
+#define NR_HOST_THREADS 0  // 0 for all online cores
+#endif
+#define MAX_HOST_THREADS 256
 #ifndef DPU_BINARY
 #warning "No DPU_BINARY defined, fall back to bin/dpu."
 #define DPU_BINARY "bin/dpu"
@@ -67,33 +76,67 @@
 #define DPU_ALLOC_BINARY "bin/dpu_alloc"
 #endif
 
-#if defined(CLIQUE2)
+// pattern ids, also the index of the kernel in the ALL_PATTERNS dpu binary
+#define PATTERN_CLIQUE2 0
+#define PATTERN_CLIQUE3 1
+#define PATTERN_CLIQUE4 2
+#define PATTERN_CLIQUE5 3
+#define PATTERN_CYCLE4 4
+#define PATTERN_HOUSE5 5
+#define PATTERN_TRI_TRI6 6
+#define PATTERN_GENERATED 7  // kernel bin/codegen wrote for the SPEC of a PATTERN=GEN build
+#define NR_PATTERNS 8
+
+#if defined(ALL_PATTERNS)
+// every kernel is linked and the patterns are picked at runtime, so the graph is kept whole
+// and in degree order
+#define PATTERN_NAME "all"
+#elif defined(CLIQUE2)
 #define KERNEL_FUNC clique2
+#define PATTERN_ID PATTERN_CLIQUE2
 #define PATTERN_NAME "clique2"
 #elif defined(CLIQUE3)
 #define KERNEL_FUNC clique3
+#define PATTERN_ID PATTERN_CLIQUE3
 #define PATTERN_NAME "clique3"
 #elif defined(CLIQUE4)
 #define KERNEL_FUNC clique4
+#define PATTERN_ID PATTERN_CLIQUE4
 #define PATTERN_NAME "clique4"
 #elif defined(CLIQUE5)
 #define KERNEL_FUNC clique5
+#define PATTERN_ID PATTERN_CLIQUE5
 #define PATTERN_NAME "clique5"
 #elif defined(CYCLE4)
 #define KERNEL_FUNC cycle4
+#define PATTERN_ID PATTERN_CYCLE4
 #define PATTERN_NAME "cycle4"
 #elif defined(HOUSE5)
 #define KERNEL_FUNC house5
+#define PATTERN_ID PATTERN_HOUSE5
 #define PATTERN_NAME "house5"
 #elif defined(TRI_TRI6)
 #define KERNEL_FUNC tri_tri6
+#define PATTERN_ID PATTERN_TRI_TRI6
 #define PATTERN_NAME "tri_tri6"
+#elif defined(GENERATED)
+#include <generated.h>  // GENERATED_* of the pattern, next to the generated kernels
+#define KERNEL_FUNC GENERATED_FUNC
+#define PATTERN_ID PATTERN_GENERATED
+#define PATTERN_NAME GENERATED_NAME
 #else
 #warning "No kernel function selected, fall back to clique2."
 #define KERNEL_FUNC clique2
+#define PATTERN_ID PATTERN_CLIQUE2
 #define PATTERN_NAME "clique2"
 #endif
 
+#ifdef ALL_PATTERNS
+#define BUILT_PATTERNS ((1u << PATTERN_GENERATED) - 1)  // every hand-written kernel
+#else
+#define BUILT_PATTERNS (1u << PATTERN_ID)
+#endif
+
 #define node_t uint32_t
 #define edge_ptr uint32_t
 #define ans_t uint64_t
@@ -107,17 +150,45 @@
 #define BUF_SIZE 32
 #define MRAM_BUF_SIZE 32768
 #define BRANCH_LEVEL_THRESHOLD 16
+#define GALLOP_RATIO 32  // host intersections gallop through the larger set beyond this size ratio
+#define SET_OP_SLACK 16  // entries a host intersection may write past its result
 #define PARTITION_M ((1<<22)/sizeof(node_t))
+#define PARTITION_N (1<<23)  // max vertices supported by DPU-assisted compaction
+#define GRANULE_LATCH_NUM 8
+#define PARTITION_TOLERANCE 0.05  // workload imbalance allowed by LOCALITY_PARTITION
+#define LOCALITY_HEAVY_SHARE 0.05  // LOCALITY_PARTITION spreads roots above this share of a dpu's workload through the heap
+#define LABEL_ROUNDS 4
+#define SPLIT_SHARE 0.5  // roots worth more than this share of a dpu's workload are split
+#define DPU_SPLIT_NUM 1024  // split ranges per dpu
+#define EPOCH_GROWTH 1.25  // MULTI_PASS retries the allocation with this many times the epochs
+#define HYBRID_THREAD_DPUS 2.0  // dpus one host thread is worth under the workload model, sets the HYBRID_CPU share
+#define SCHEDULE_SHARE 0.25  // fraction of the remaining own roots a dpu takes per wave with DYNAMIC_SCHEDULE
+#define SCHEDULE_MIN_ROOTS 256
+#define SCHEDULE_POLL_US 50
+#define SERVER_BACKLOG 16  // clients waiting for the query server
+#define PROFILE_RIDGE 1e-4  // regularization of the PROFILE_MODEL fit, relative to the feature variance
+#define PARTITION_BLOCK 64  // wram block of DPU-assisted compaction, in 4-byte elements
 
 typedef struct Graph {
     node_t n;  // number of vertices
     edge_ptr m;  // number of edges
-    edge_ptr row_ptr[N];
-    node_t col_idx[M];
-    uint64_t root_num[NR_DPUS];  // number of search roots allocated to dpu
-    node_t *roots[NR_DPUS];
+    edge_ptr *row_ptr;  // n + 1 entries
+    node_t *col_idx;  // m entries, allocated together with row_ptr
+    uint32_t epoch_num;  // passes over the roots, only MULTI_PASS makes more than one
+    uint32_t part_num;  // root lists, nr_dpus per epoch, part i runs on dpu i % nr_dpus
+    // part_num entries each
+    uint64_t *root_num;  // number of search roots allocated to dpu
+    uint64_t *spare_num;  // roots of other dpus whose neighborhood is also resident, kept after the own ones
+    uint64_t *split_num;  // the first split_num roots only cover a range of their row
+    node_t **roots;
+    node_t **local_roots;  // dpu ids of roots, NULL when the dpu holds the whole graph
+    edge_ptr **split_range;  // [begin, end) of each split root, relative to its row
+    uint64_t cpu_root_num;  // roots mined by the host threads with HYBRID_CPU
+    node_t *cpu_roots;
 } Graph;
 
+extern uint32_t nr_dpus;  // dpus of the allocated set, known once the host has allocated it
+
 #define ALIGN(x, a) (((x) + (a)-1) & ~((a)-1))
 #define ALIGN2(x) ALIGN(x, 2)
 #define ALIGN4(x) ALIGN(x, 4)
@@ -128,6 +199,7 @@ typedef struct Graph {
 #define ALIGN4_LOWER(x) ALIGN_LOWER(x, 4)
 #define ALIGN8_LOWER(x) ALIGN_LOWER(x, 8)
 #define ALIGN16_LOWER(x) ALIGN_LOWER(x, 16)
+#define BITMAP_WORDS(n) (ALIGN((uint64_t)(n), 64) >> 5)  // uint32_t words, padded for 8-byte transfers
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+typedef void (*parallel_func_t)(uint32_t tid, uint32_t nr_threads, void *arg);
+
+uint32_t host_thread_num();
+void parallel_run(parallel_func_t func, void *arg);
+
+// [begin, end) of the tid-th even slice of [0, size)
+static inline void parallel_range(uint64_t size, uint32_t tid, uint32_t nr_threads, uint64_t *begin, uint64_t *end) {
+    *begin = size * tid / nr_threads;
+    *end = size * (tid + 1) / nr_threads;
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,29 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <common.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// compacted graph of one dpu, indexed by local ids
+typedef struct DpuImage {
+    uint64_t row_size;  // local vertices, row_ptr holds row_size + 1 entries
+    uint64_t col_size;  // local edges
+    edge_ptr *row_ptr;
+    node_t *col_idx;
+    node_t *roots;  // local ids of the root_num[dpu] roots
+} DpuImage;
+
+DpuImage *alloc_images(uint64_t row_stride, uint64_t col_stride, uint64_t root_stride);
+void free_images(DpuImage *images);
+void graph_parts(Graph *g, uint32_t epoch_num);
+
+extern uint32_t pattern_set;  // bit per PATTERN_* id
+
+// preprocessed graph cache
+void cache_path(const char *data_path, char *path, size_t size);
+uint64_t cache_key(const void *data, size_t size, const void *profile, size_t profile_size);
+bool cache_load(const char *path, uint64_t key, Graph *g, DpuImage **images);
+void cache_store(const char *path, uint64_t key, Graph *g, DpuImage *images);
+
+#endif // PARTITION_H
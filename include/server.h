@@ -0,0 +1,13 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <common.h>
+#include <stdbool.h>
+
+// count one pattern on the resident graph, false if a dpu failed or an answer is wrong
+typedef bool (*query_func_t)(uint32_t pattern, ans_t *total);
+
+// answer queries on a unix socket until a shutdown request, SIGINT or SIGTERM
+void serve(const char *socket_path, uint32_t supported, query_func_t query);
+
+#endif // SERVER_H